@@ -1,29 +1,12 @@
-QT       += core gui
-
-greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
-
-CONFIG += c++11
-TARGET = BitSketch
-
-# You can make your code fail to compile if it uses deprecated APIs.
-# In order to do so, uncomment the following line.
-#DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
-
-SOURCES += \
-    main.cpp \
-    mainwindow.cpp \
-    pixelartdialog.cpp \
-    previewdialog.cpp
-
-HEADERS += \
-    mainwindow.h \
-    pixelartdialog.h \
-    previewdialog.h
-
-FORMS += \
-    mainwindow.ui
-
-# Default rules for deployment.
-qnx: target.path = /tmp/$${TARGET}/bin
-else: unix:!android: target.path = /opt/$${TARGET}/bin
-!isEmpty(target.path): INSTALLS += target
+# bitsketch-core holds conversion, packing, export and the pixel store and
+# links only QtCore/QtGui. The editor (app) and the headless converter (cli)
+# are thin front ends on top of it.
+TEMPLATE = subdirs
+
+SUBDIRS += \
+    core \
+    app \
+    cli
+
+app.depends = core
+cli.depends = core
@@ -0,0 +1,39 @@
+QT       += core gui
+
+greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
+
+CONFIG += c++11
+TARGET = BitSketch
+
+include(../core/core.pri)
+
+# You can make your code fail to compile if it uses deprecated APIs.
+# In order to do so, uncomment the following line.
+#DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
+
+SRC = $$PWD/..
+
+SOURCES += \
+    $$SRC/canvasitem.cpp \
+    $$SRC/canvasview.cpp \
+    $$SRC/main.cpp \
+    $$SRC/mainwindow.cpp \
+    $$SRC/pixelartdialog.cpp \
+    $$SRC/previewdialog.cpp \
+    $$SRC/stallwatchdog.cpp
+
+HEADERS += \
+    $$SRC/canvasitem.h \
+    $$SRC/canvasview.h \
+    $$SRC/mainwindow.h \
+    $$SRC/pixelartdialog.h \
+    $$SRC/previewdialog.h \
+    $$SRC/stallwatchdog.h
+
+FORMS += \
+    $$SRC/mainwindow.ui
+
+# Default rules for deployment.
+qnx: target.path = /tmp/$${TARGET}/bin
+else: unix:!android: target.path = /opt/$${TARGET}/bin
+!isEmpty(target.path): INSTALLS += target
@@ -0,0 +1,477 @@
+#include "assetbuild.h"
+#include "framedelta.h"
+#include "hexexport.h"
+#include "tileset.h"
+#include "trace.h"
+#include "workpool.h"
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSaveFile>
+#include <QSettings>
+
+namespace {
+
+const char* const CacheDirName = ".bitsketch-build";
+const quint32 CacheVersion = 1;
+
+QString identifier(const QString& name) {
+    QString id;
+    for (QChar c : name) {
+        id += (c.isLetterOrNumber() && c.unicode() < 128) ? c : QChar('_');
+    }
+    if (id.isEmpty() || id[0].isDigit()) id.prepend('_');
+    return id;
+}
+
+bool parseFormat(const QString& text, AssetBuild::Format& format) {
+    const QString name = text.toLower();
+    if (name.isEmpty() || name == "bitmap" || name == "rgb565") {
+        format = AssetBuild::Bitmap;
+    } else if (name == "tileset") {
+        format = AssetBuild::TilesetFormat;
+    } else if (name == "delta") {
+        format = AssetBuild::Delta;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// Leaves the file alone when it already has this content, so its mtime only
+// moves when the firmware actually needs rebuilding.
+bool writeIfChanged(const QString& path, const QByteArray& content, bool& changed, QString& error) {
+    QFile existing(path);
+    if (existing.open(QIODevice::ReadOnly) && existing.size() == content.size() && existing.readAll() == content) {
+        changed = false;
+        return true;
+    }
+    existing.close();
+
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly) || file.write(content) != content.size() || !file.commit()) {
+        error = QString("Can't write %1: %2").arg(path, file.errorString());
+        return false;
+    }
+    changed = true;
+    return true;
+}
+
+} // namespace
+
+AssetBuild::AssetBuild() : converted(0), upToDate(0), wroteOutput(false) {}
+
+bool AssetBuild::loadManifest(const QString& path) {
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        error = QString("Can't open %1: %2").arg(path, file.errorString());
+        return false;
+    }
+    manifestDir = QFileInfo(path).absolutePath();
+    outputName = QFileInfo(path).completeBaseName();
+    assetList.clear();
+    assetIndex.clear();
+
+    if (path.endsWith(".ini", Qt::CaseInsensitive)) {
+        file.close();
+        return parseIni(path);
+    }
+    return parseJson(file.readAll());
+}
+
+bool AssetBuild::parseJson(const QByteArray& data) {
+    QJsonParseError parseError;
+    const QJsonDocument document = QJsonDocument::fromJson(data, &parseError);
+    if (!document.isObject()) {
+        error = QString("Invalid manifest: %1").arg(parseError.errorString());
+        return false;
+    }
+
+    const QJsonObject root = document.object();
+    outputName = root.value("output").toString(outputName);
+    for (const QJsonValue& value : root.value("assets").toArray()) {
+        const QJsonObject object = value.toObject();
+        Asset asset;
+        asset.name = object.value("name").toString();
+        asset.source = object.value("source").toString();
+        if (!parseFormat(object.value("format").toString(), asset.format)) {
+            error = QString("%1: unknown format \"%2\"").arg(asset.name, object.value("format").toString());
+            return false;
+        }
+        asset.tileSize = object.value("tileSize").toInt(16);
+        asset.flips = object.value("flips").toBool(false);
+        asset.reference = object.value("reference").toString();
+        for (const QJsonValue& dependency : object.value("dependsOn").toArray()) {
+            asset.dependsOn.append(dependency.toString());
+        }
+        if (!addAsset(asset)) return false;
+    }
+    return true;
+}
+
+bool AssetBuild::parseIni(const QString& path) {
+    QSettings settings(path, QSettings::IniFormat);
+    if (settings.status() != QSettings::NoError) {
+        error = QString("Invalid manifest: %1").arg(path);
+        return false;
+    }
+
+    outputName = settings.value("output", outputName).toString();
+    for (const QString& group : settings.childGroups()) {
+        settings.beginGroup(group);
+        Asset asset;
+        asset.name = group;
+        asset.source = settings.value("source").toString();
+        if (!parseFormat(settings.value("format").toString(), asset.format)) {
+            error = QString("%1: unknown format \"%2\"").arg(group, settings.value("format").toString());
+            return false;
+        }
+        asset.tileSize = settings.value("tileSize", 16).toInt();
+        asset.flips = settings.value("flips", false).toBool();
+        asset.reference = settings.value("reference").toString();
+        asset.dependsOn = settings.value("dependsOn").toStringList();
+        settings.endGroup();
+        if (!addAsset(asset)) return false;
+    }
+    return true;
+}
+
+bool AssetBuild::addAsset(const Asset& asset) {
+    if (asset.name.isEmpty() || asset.source.isEmpty()) {
+        error = QString("Asset %1 needs a name and a source").arg(assetList.size() + 1);
+        return false;
+    }
+    if (assetIndex.contains(asset.name)) {
+        error = QString("Asset %1 is listed twice").arg(asset.name);
+        return false;
+    }
+    if (asset.format == Delta && asset.reference.isEmpty()) {
+        error = QString("%1: delta assets need a reference").arg(asset.name);
+        return false;
+    }
+    if (asset.format == TilesetFormat && (asset.tileSize <= 0 || asset.tileSize > 256)) {
+        error = QString("%1: invalid tile size %2").arg(asset.name).arg(asset.tileSize);
+        return false;
+    }
+    assetIndex.insert(asset.name, assetList.size());
+    assetList.append(asset);
+    return true;
+}
+
+QString AssetBuild::sourcePath(const QString& file) const {
+    return QDir(manifestDir).absoluteFilePath(file);
+}
+
+QString AssetBuild::referencePath(const Asset& asset) const {
+    auto it = assetIndex.constFind(asset.reference);
+    return it != assetIndex.constEnd() ? sourcePath(assetList[*it].source) : sourcePath(asset.reference);
+}
+
+QString AssetBuild::cachePath(const Asset& asset) const {
+    return outputDir + "/" + CacheDirName + "/" + identifier(asset.name) + ".cache";
+}
+
+QByteArray AssetBuild::optionsKey(const Asset& asset) const {
+    QString key = QString("%1|%2|%3").arg(int(asset.format)).arg(asset.tileSize).arg(asset.flips);
+    if (asset.format == Delta) key += "|" + referencePath(asset);
+    return key.toUtf8();
+}
+
+QByteArray AssetBuild::inputStamp(const Asset& asset) const {
+    QStringList inputs = {sourcePath(asset.source)};
+    if (asset.format == Delta) inputs.append(referencePath(asset));
+    QByteArray stamp;
+    for (const QString& input : inputs) {
+        QFileInfo info(input);
+        stamp += QString("%1|%2|%3;").arg(input).arg(info.size()).arg(info.lastModified().toMSecsSinceEpoch()).toUtf8();
+    }
+    return stamp;
+}
+
+// Kahn's algorithm; anything left with unmet dependencies is part of a cycle.
+bool AssetBuild::planOrder(QVector<QVector<int>>& dependents, QVector<int>& dependencyCounts) {
+    dependents = QVector<QVector<int>>(assetList.size());
+    dependencyCounts = QVector<int>(assetList.size(), 0);
+    for (int i = 0; i < assetList.size(); ++i) {
+        // A delta reference that is not an asset name is a plain image path.
+        QStringList names = assetList[i].dependsOn;
+        if (assetList[i].format == Delta && assetIndex.contains(assetList[i].reference)
+            && !names.contains(assetList[i].reference)) {
+            names.append(assetList[i].reference);
+        }
+        for (const QString& name : names) {
+            auto it = assetIndex.constFind(name);
+            if (it == assetIndex.constEnd()) {
+                error = QString("%1 depends on unknown asset %2").arg(assetList[i].name, name);
+                return false;
+            }
+            dependents[*it].append(i);
+            ++dependencyCounts[i];
+        }
+    }
+
+    QVector<int> counts = dependencyCounts;
+    QVector<int> ready;
+    for (int i = 0; i < counts.size(); ++i) {
+        if (counts[i] == 0) ready.append(i);
+    }
+    int visited = 0;
+    while (!ready.isEmpty()) {
+        const int index = ready.takeLast();
+        ++visited;
+        for (int dependent : dependents[index]) {
+            if (--counts[dependent] == 0) ready.append(dependent);
+        }
+    }
+    if (visited != assetList.size()) {
+        QStringList cycle;
+        for (int i = 0; i < counts.size(); ++i) {
+            if (counts[i] > 0) cycle.append(assetList[i].name);
+        }
+        error = QString("Dependency cycle between %1").arg(cycle.join(", "));
+        return false;
+    }
+    return true;
+}
+
+bool AssetBuild::build(const QString& outputDirectory, int threadCount) {
+    outputDir = QDir(outputDirectory).absolutePath();
+    if (!QDir().mkpath(outputDir + "/" + CacheDirName)) {
+        error = QString("Can't create %1").arg(outputDir);
+        return false;
+    }
+
+    QVector<QVector<int>> dependents;
+    QVector<int> dependencyCounts;
+    if (!planOrder(dependents, dependencyCounts)) return false;
+
+    results = QVector<Result>(assetList.size());
+    converted = 0;
+    upToDate = 0;
+
+    // Assets start as soon as their last dependency has finished, on the
+    // worker that finished it.
+    WorkStealingPool pool(threadCount);
+    std::function<void(int)> schedule = [&](int index) {
+        pool.submit([&, index] {
+            buildAsset(index);
+            QVector<int> ready;
+            {
+                QMutexLocker locker(&resultMutex);
+                if (dependents[index].isEmpty()) results[index].image = QImage();
+                for (int dependent : dependents[index]) {
+                    if (--dependencyCounts[dependent] == 0) ready.append(dependent);
+                }
+            }
+            for (int dependent : ready) {
+                schedule(dependent);
+            }
+        });
+    };
+    for (int i = 0; i < assetList.size(); ++i) {
+        if (dependencyCounts[i] == 0) schedule(i);
+    }
+    pool.waitForDone();
+
+    QStringList failures;
+    for (int i = 0; i < results.size(); ++i) {
+        if (!results[i].ok) failures.append(QString("%1: %2").arg(assetList[i].name, results[i].error));
+        results[i].image = QImage();
+    }
+    if (!failures.isEmpty()) {
+        error = failures.join("\n");
+        return false;
+    }
+    return writeCombined();
+}
+
+void AssetBuild::buildAsset(int index) {
+    TRACE_SCOPE("AssetBuild::buildAsset");
+    const Asset& asset = assetList[index];
+    const QByteArray options = optionsKey(asset);
+    const QByteArray stamp = inputStamp(asset);
+
+    Result result;
+    result.ok = false;
+    result.reused = false;
+    result.width = 0;
+    result.height = 0;
+    result.length = 0;
+
+    QByteArray cachedOptions, cachedStamp, cachedHash;
+    Result cached = result;
+    bool haveCache = false;
+    QFile cacheFile(cachePath(asset));
+    if (cacheFile.open(QIODevice::ReadOnly)) {
+        QDataStream in(&cacheFile);
+        quint32 version = 0;
+        in >> version;
+        if (version == CacheVersion) {
+            qint32 width, height;
+            in >> cachedOptions >> cachedStamp >> cachedHash >> cached.code >> cached.declarations
+               >> cached.dataSymbol >> width >> height >> cached.length;
+            cached.width = width;
+            cached.height = height;
+            haveCache = in.status() == QDataStream::Ok && cachedOptions == options;
+        }
+        cacheFile.close();
+    }
+
+    auto finish = [&](const Result& finished, bool didConvert) {
+        QMutexLocker locker(&resultMutex);
+        results[index] = finished;
+        if (finished.ok) ++(didConvert ? converted : upToDate);
+    };
+
+    if (haveCache && cachedStamp == stamp) {
+        cached.ok = true;
+        cached.reused = true;
+        finish(cached, false);
+        return;
+    }
+
+    const QImage image(sourcePath(asset.source));
+    if (image.isNull()) {
+        result.error = QString("can't decode %1").arg(sourcePath(asset.source));
+        finish(result, false);
+        return;
+    }
+
+    QImage reference;
+    if (asset.format == Delta) {
+        auto it = assetIndex.constFind(asset.reference);
+        if (it != assetIndex.constEnd()) {
+            QMutexLocker locker(&resultMutex);
+            reference = results[*it].image;
+        }
+        if (reference.isNull()) reference = QImage(referencePath(asset));
+        if (reference.isNull()) {
+            result.error = QString("can't decode reference %1").arg(referencePath(asset));
+            finish(result, false);
+            return;
+        }
+    }
+
+    QCryptographicHash inputHash(QCryptographicHash::Md5);
+    inputHash.addData(imageContentHash(image));
+    if (!reference.isNull()) inputHash.addData(imageContentHash(reference));
+    const QByteArray hash = inputHash.result();
+
+    bool didConvert = false;
+    if (haveCache && cachedHash == hash) {
+        result = cached;
+        result.reused = true;
+    } else {
+        const QString prefix = assetSymbolName(asset.name);
+        result.width = image.width();
+        result.height = image.height();
+        if (asset.format == Bitmap) {
+            result.code = imageToHexArray(image, prefix);
+            result.declarations = QStringList{QString("extern const uint16_t %1 [];").arg(prefix)};
+            result.dataSymbol = prefix;
+            result.length = image.width() * image.height();
+        } else if (asset.format == TilesetFormat) {
+            Tileset tileset;
+            if (!tileset.build(image, asset.tileSize, asset.flips)) {
+                result.error = tileset.errorString();
+                finish(result, false);
+                return;
+            }
+            result.code = tileset.toHex(prefix);
+            result.declarations = QStringList{QString("extern const uint16_t %1_tiles [];").arg(prefix),
+                                              QString("extern const uint16_t %1_tilemap [];").arg(prefix)};
+            result.dataSymbol = prefix + "_tiles";
+            result.length = tileset.tiles().size();
+        } else {
+            FrameDelta delta;
+            delta.setReference(reference);
+            if (!delta.addFrame(image)) {
+                result.error = delta.errorString();
+                finish(result, false);
+                return;
+            }
+            result.code = delta.toHex(prefix);
+            result.declarations = QStringList{QString("extern const uint16_t %1_delta_rects [];").arg(prefix),
+                                              QString("extern const uint32_t %1_delta_frame_rects [];").arg(prefix),
+                                              QString("extern const uint16_t %1_delta_pixels [];").arg(prefix)};
+            result.dataSymbol = prefix + "_delta_pixels";
+            result.length = delta.pixelCount();
+        }
+        didConvert = true;
+    }
+
+    QSaveFile out(cachePath(asset));
+    if (out.open(QIODevice::WriteOnly)) {
+        QDataStream stream(&out);
+        stream << CacheVersion << options << stamp << hash << result.code << result.declarations
+               << result.dataSymbol << qint32(result.width) << qint32(result.height) << result.length;
+        out.commit();
+    }
+
+    result.ok = true;
+    result.image = image;
+    finish(result, didConvert);
+}
+
+bool AssetBuild::writeCombined() {
+    TRACE_SCOPE("AssetBuild::writeCombined");
+    const QString base = identifier(outputName);
+    const QString guard = base.toUpper() + "_H";
+
+    QByteArray header;
+    header += "// Generated by BitSketch. Do not edit.\n";
+    header += QString("#ifndef %1\n#define %1\n\n").arg(guard).toLatin1();
+    header += "#include <stdint.h>\n"
+              "#if defined(__AVR__)\n#include <avr/pgmspace.h>\n#elif !defined(PROGMEM)\n#define PROGMEM\n#endif\n\n"
+              "#ifndef BITSKETCH_ASSET_DEFINED\n#define BITSKETCH_ASSET_DEFINED\n"
+              "enum { BITSKETCH_BITMAP = 0, BITSKETCH_TILESET = 1, BITSKETCH_DELTA = 2 };\n"
+              "typedef struct {\n"
+              "    const char* name;\n"
+              "    uint8_t format;\n"
+              "    uint16_t width;\n"
+              "    uint16_t height;\n"
+              "    const uint16_t* data;\n"
+              "    uint32_t length;\n"
+              "} BitSketchAsset;\n"
+              "#endif\n\n";
+    for (const Result& result : results) {
+        for (const QString& declaration : result.declarations) {
+            header += declaration.toLatin1() + "\n";
+        }
+    }
+    header += QString("\nextern const BitSketchAsset %1_table [];\n").arg(base).toLatin1();
+    header += QString("extern const uint32_t %1_count;\n\n#endif // %2\n").arg(base, guard).toLatin1();
+
+    QByteArray source;
+    source += "// Generated by BitSketch. Do not edit.\n";
+    source += QString("#include \"%1.h\"\n").arg(outputName).toLatin1();
+    for (int i = 0; i < assetList.size(); ++i) {
+        source += QString("\n// %1 (%2)\n").arg(assetList[i].name, assetList[i].source).toLatin1();
+        source += results[i].code;
+    }
+    source += QString("\nconst BitSketchAsset %1_table [] = {\n").arg(base).toLatin1();
+    static const char* const formatNames[] = {"BITSKETCH_BITMAP", "BITSKETCH_TILESET", "BITSKETCH_DELTA"};
+    for (int i = 0; i < assetList.size(); ++i) {
+        const Result& result = results[i];
+        source += QString("    {\"%1\", %2, %3, %4, %5, %6},\n")
+                      .arg(assetList[i].name, formatNames[assetList[i].format])
+                      .arg(result.width)
+                      .arg(result.height)
+                      .arg(result.dataSymbol)
+                      .arg(result.length)
+                      .toLatin1();
+    }
+    source += "};\n";
+    source += QString("const uint32_t %1_count = %2;\n").arg(base).arg(assetList.size()).toLatin1();
+
+    bool headerChanged = false, sourceChanged = false;
+    if (!writeIfChanged(outputDir + "/" + outputName + ".h", header, headerChanged, error)) return false;
+    if (!writeIfChanged(outputDir + "/" + outputName + ".cpp", source, sourceChanged, error)) return false;
+    wroteOutput = headerChanged || sourceChanged;
+    return true;
+}
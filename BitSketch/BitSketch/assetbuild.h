@@ -0,0 +1,97 @@
+#ifndef ASSETBUILD_H
+#define ASSETBUILD_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QImage>
+#include <QMutex>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+// Manifest-driven batch export. A manifest (JSON or INI) lists assets with a
+// name, a source image, an export format and its options. The build orders
+// them by their dependencies, converts them on a WorkStealingPool and writes
+// one header and one source containing every asset plus an asset table.
+//
+// Every asset keeps its generated code in <output>/.bitsketch-build. An asset
+// whose inputs have the same size and mtime as last time is not decoded at
+// all; one whose files changed but whose pixels did not is not converted
+// again. The combined files are only rewritten when their content changes,
+// so an unchanged build does not trigger a firmware recompile.
+//
+// JSON:
+//   { "output": "assets",
+//     "assets": [ { "name": "logo", "source": "logo.png" },
+//                 { "name": "map", "source": "map.png", "format": "tileset", "tileSize": 16, "flips": true },
+//                 { "name": "walk2", "source": "walk2.png", "format": "delta", "reference": "walk1" } ] }
+// INI: [General] output=assets, then one group per asset with the same keys.
+//
+// A delta asset whose reference names another asset depends on it and reuses
+// its decoded image. Other dependencies can be listed in "dependsOn".
+class AssetBuild {
+public:
+    enum Format { Bitmap, TilesetFormat, Delta };
+
+    struct Asset {
+        QString name;
+        QString source;
+        Format format;
+        int tileSize;
+        bool flips;
+        QString reference;
+        QStringList dependsOn;
+    };
+
+    AssetBuild();
+
+    bool loadManifest(const QString& path);
+    bool build(const QString& outputDir, int threadCount);
+    QString errorString() const { return error; }
+
+    const QVector<Asset>& assets() const { return assetList; }
+    int convertedCount() const { return converted; }
+    int upToDateCount() const { return upToDate; }
+    bool outputChanged() const { return wroteOutput; }
+
+private:
+    struct Result {
+        bool ok;
+        QString error;
+        QImage image;        // decoded source, if this build needed it
+        QByteArray hash;     // pixel hash of all inputs, if known
+        QByteArray code;     // generated arrays
+        QStringList declarations;
+        QString dataSymbol;
+        int width;
+        int height;
+        quint32 length;
+        bool reused;
+    };
+
+    bool parseJson(const QByteArray& data);
+    bool parseIni(const QString& path);
+    bool addAsset(const Asset& asset);
+    bool planOrder(QVector<QVector<int>>& dependents, QVector<int>& dependencyCounts);
+    void buildAsset(int index);
+    QString cachePath(const Asset& asset) const;
+    QString sourcePath(const QString& file) const;
+    QString referencePath(const Asset& asset) const;
+    QByteArray optionsKey(const Asset& asset) const;
+    QByteArray inputStamp(const Asset& asset) const;
+    bool writeCombined();
+
+    QString error;
+    QString manifestDir;
+    QString outputName;
+    QString outputDir;
+    QVector<Asset> assetList;
+    QHash<QString, int> assetIndex;
+    QVector<Result> results;
+    QMutex resultMutex;
+    int converted;
+    int upToDate;
+    bool wroteOutput;
+};
+
+#endif // ASSETBUILD_H
@@ -0,0 +1,178 @@
+#include "assetwatcher.h"
+#include "hexexport.h"
+#include "trace.h"
+#include <QDataStream>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QImage>
+#include <QSaveFile>
+
+namespace {
+
+const char* const CacheName = ".bitsketch-watch.cache";
+const quint32 CacheVersion = 1;
+
+const QStringList& imageFilters() {
+    static const QStringList filters = {"*.png", "*.jpg", "*.jpeg", "*.bmp"};
+    return filters;
+}
+
+} // namespace
+
+AssetWatcher::AssetWatcher(const QString& sourceDir, const QString& outputDir, QObject* parent)
+    : QObject(parent), sourceDir(QDir(sourceDir).absolutePath()), outputDir(QDir(outputDir).absolutePath()) {
+    debounce.setSingleShot(true);
+    debounce.setInterval(DebounceMs);
+    connect(&debounce, &QTimer::timeout, this, &AssetWatcher::processPending);
+    connect(&watcher, &QFileSystemWatcher::directoryChanged, this, &AssetWatcher::directoryChanged);
+    connect(&watcher, &QFileSystemWatcher::fileChanged, this, &AssetWatcher::fileChanged);
+}
+
+bool AssetWatcher::start() {
+    if (!QFileInfo(sourceDir).isDir()) {
+        error = QString("%1 is not a directory").arg(sourceDir);
+        return false;
+    }
+    if (!QDir().mkpath(outputDir)) {
+        error = QString("Can't create %1").arg(outputDir);
+        return false;
+    }
+    loadCache();
+    watcher.addPath(sourceDir);
+    scanDirectory();
+    processPending();
+    return true;
+}
+
+QString AssetWatcher::outputPath(const QString& source) const {
+    return outputDir + "/" + QFileInfo(source).completeBaseName() + ".h";
+}
+
+// Editors that save through a temporary file and rename replace the inode,
+// which drops its watch, so files are (re)added on every directory change.
+void AssetWatcher::scanDirectory() {
+    const QFileInfoList files = QDir(sourceDir).entryInfoList(imageFilters(), QDir::Files);
+    QSet<QString> present;
+    QStringList unwatched;
+    const QStringList watched = watcher.files();
+    const QSet<QString> watchedSet(watched.begin(), watched.end());
+    for (const QFileInfo& info : files) {
+        const QString path = info.absoluteFilePath();
+        present.insert(path);
+        if (!watchedSet.contains(path)) unwatched.append(path);
+
+        auto it = cache.constFind(path);
+        if (it == cache.constEnd() || it->size != info.size()
+            || it->modified != info.lastModified().toMSecsSinceEpoch() || !QFile::exists(outputPath(path))) {
+            pending.insert(path);
+        }
+    }
+    if (!unwatched.isEmpty()) watcher.addPaths(unwatched);
+
+    for (auto it = cache.begin(); it != cache.end();) {
+        if (!present.contains(it.key())) {
+            it = cache.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void AssetWatcher::schedule(const QString& path) {
+    pending.insert(path);
+    debounce.start();
+}
+
+void AssetWatcher::directoryChanged(const QString&) {
+    scanDirectory();
+    if (!pending.isEmpty()) debounce.start();
+}
+
+void AssetWatcher::fileChanged(const QString& path) {
+    schedule(path);
+}
+
+void AssetWatcher::processPending() {
+    if (pending.isEmpty()) return;
+    const QSet<QString> batch = pending;
+    pending.clear();
+    for (const QString& path : batch) {
+        process(path);
+    }
+    saveCache();
+}
+
+void AssetWatcher::process(const QString& path) {
+    TRACE_SCOPE("AssetWatcher::process");
+    QElapsedTimer timer;
+    timer.start();
+
+    QFileInfo info(path);
+    if (!info.exists()) {
+        cache.remove(path);
+        return;
+    }
+    if (!watcher.files().contains(path)) watcher.addPath(path);
+
+    CacheEntry entry;
+    entry.size = info.size();
+    entry.modified = info.lastModified().toMSecsSinceEpoch();
+    const QString output = outputPath(path);
+
+    // A file still being written may not decode yet; its next change event
+    // schedules it again.
+    QImage image(path);
+    if (image.isNull()) {
+        emit failed(path, "can't decode image");
+        return;
+    }
+    entry.hash = imageContentHash(image);
+
+    auto cached = cache.constFind(path);
+    if (cached != cache.constEnd() && cached->hash == entry.hash && QFile::exists(output)) {
+        cache.insert(path, entry);
+        return;
+    }
+
+    QSaveFile file(output);
+    if (!file.open(QIODevice::WriteOnly)) {
+        emit failed(path, file.errorString());
+        return;
+    }
+    file.write(imageToHexArray(image, assetSymbolName(info.completeBaseName())));
+    if (!file.commit()) {
+        emit failed(path, file.errorString());
+        return;
+    }
+    cache.insert(path, entry);
+    emit converted(path, output, timer.elapsed());
+}
+
+void AssetWatcher::loadCache() {
+    QFile file(outputDir + "/" + CacheName);
+    if (!file.open(QIODevice::ReadOnly)) return;
+    QDataStream in(&file);
+    quint32 version;
+    qint32 count;
+    in >> version >> count;
+    if (version != CacheVersion) return;
+    for (int i = 0; i < count && in.status() == QDataStream::Ok; ++i) {
+        QString path;
+        CacheEntry entry;
+        in >> path >> entry.size >> entry.modified >> entry.hash;
+        cache.insert(path, entry);
+    }
+}
+
+void AssetWatcher::saveCache() const {
+    QSaveFile file(outputDir + "/" + CacheName);
+    if (!file.open(QIODevice::WriteOnly)) return;
+    QDataStream out(&file);
+    out << CacheVersion << qint32(cache.size());
+    for (auto it = cache.constBegin(); it != cache.constEnd(); ++it) {
+        out << it.key() << it->size << it->modified << it->hash;
+    }
+    file.commit();
+}
@@ -0,0 +1,59 @@
+#ifndef ASSETWATCHER_H
+#define ASSETWATCHER_H
+
+#include <QByteArray>
+#include <QFileSystemWatcher>
+#include <QHash>
+#include <QObject>
+#include <QSet>
+#include <QTimer>
+
+// Watch mode: keeps one header per image of a directory up to date. File
+// events are collected for a short debounce interval, then each touched file
+// is checked against a cache of (size, mtime, pixel hash); only images whose
+// pixels changed are converted again. The cache is kept next to the output
+// so a restart does not reconvert everything.
+class AssetWatcher : public QObject {
+    Q_OBJECT
+
+public:
+    static const int DebounceMs = 100;
+
+    AssetWatcher(const QString& sourceDir, const QString& outputDir, QObject* parent = nullptr);
+
+    bool start();
+    QString errorString() const { return error; }
+
+signals:
+    void converted(const QString& source, const QString& output, qint64 elapsedMs);
+    void failed(const QString& source, const QString& reason);
+
+private slots:
+    void directoryChanged(const QString& path);
+    void fileChanged(const QString& path);
+    void processPending();
+
+private:
+    struct CacheEntry {
+        qint64 size;
+        qint64 modified;
+        QByteArray hash;
+    };
+
+    void scanDirectory();
+    void schedule(const QString& path);
+    void process(const QString& path);
+    QString outputPath(const QString& source) const;
+    void loadCache();
+    void saveCache() const;
+
+    QString sourceDir;
+    QString outputDir;
+    QString error;
+    QFileSystemWatcher watcher;
+    QTimer debounce;
+    QSet<QString> pending;
+    QHash<QString, CacheEntry> cache;
+};
+
+#endif // ASSETWATCHER_H
@@ -0,0 +1,283 @@
+#include "autosavejournal.h"
+#include <QCoreApplication>
+#include <QDataStream>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QStandardPaths>
+
+namespace {
+
+const char* const CheckpointName = "checkpoint.bsk";
+const char* const LogName = "journal.log";
+const char* const LockName = "session.lock";
+
+} // namespace
+
+AutosaveJournal::AutosaveJournal(QObject* parent)
+    : QThread(parent), stopping(false), operationsSinceCheckpoint(0) {}
+
+AutosaveJournal::~AutosaveJournal() {
+    finishSession();
+}
+
+QString AutosaveJournal::autosaveRoot() {
+    return QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation) + "/autosave";
+}
+
+void AutosaveJournal::startSession() {
+    static int sessionCounter = 0;
+    sessionDir = QString("%1/%2-%3-%4")
+                     .arg(autosaveRoot())
+                     .arg(QDateTime::currentMSecsSinceEpoch())
+                     .arg(QCoreApplication::applicationPid())
+                     .arg(sessionCounter++);
+    QDir().mkpath(sessionDir);
+    lock.reset(new QLockFile(sessionDir + "/" + LockName));
+    lock->setStaleLockTime(0);
+    lock->tryLock(0);
+
+    stopping = false;
+    start(QThread::LowPriority);
+}
+
+// A clean shutdown leaves nothing behind to recover. Locks are only treated
+// as stale when their owning process is gone (stale lock time 0).
+void AutosaveJournal::finishSession() {
+    if (sessionDir.isEmpty()) return;
+    {
+        QMutexLocker locker(&mutex);
+        stopping = true;
+        wakeup.wakeOne();
+    }
+    wait();
+    lock.reset();
+    QDir(sessionDir).removeRecursively();
+    sessionDir.clear();
+}
+
+void AutosaveJournal::enqueue(const Record& record) {
+    if (sessionDir.isEmpty()) return;
+    QMutexLocker locker(&mutex);
+    queue.append(record);
+    wakeup.wakeOne();
+}
+
+void AutosaveJournal::recordSpans(int layer, const QVector<SpanWrite>& spans) {
+    if (spans.isEmpty()) return;
+    Record record;
+    record.type = Spans;
+    record.layer = layer;
+    record.spans = spans;
+    enqueue(record);
+    ++operationsSinceCheckpoint;
+}
+
+void AutosaveJournal::recordFill(int layer, const QRect& rect, QRgb color) {
+    Record record;
+    record.type = Fill;
+    record.layer = layer;
+    record.rect = rect;
+    record.color = color;
+    enqueue(record);
+    ++operationsSinceCheckpoint;
+}
+
+// The image is implicitly shared, so queueing it does not copy pixels on the
+// GUI thread; conversion to the on-disk format happens on the writer thread.
+void AutosaveJournal::recordBlock(int layer, const QPoint& topLeft, const QImage& block) {
+    Record record;
+    record.type = Block;
+    record.layer = layer;
+    record.rect = QRect(topLeft, block.size());
+    record.block = block;
+    enqueue(record);
+    ++operationsSinceCheckpoint;
+}
+
+void AutosaveJournal::checkpoint(ProjectState state) {
+    state.history.clear();
+    Record record;
+    record.type = Checkpoint;
+    record.layer = 0;
+    record.state = state;
+    enqueue(record);
+    operationsSinceCheckpoint = 0;
+}
+
+QByteArray AutosaveJournal::serialize(const Record& record) {
+    QByteArray payload;
+    QDataStream out(&payload, QIODevice::WriteOnly);
+    out.setByteOrder(QDataStream::LittleEndian);
+    out << quint8(record.type) << record.layer;
+    switch (record.type) {
+    case Spans:
+        out << qint32(record.spans.size());
+        for (const SpanWrite& span : record.spans) {
+            out << span.x << span.y << span.length << quint32(span.color);
+        }
+        break;
+    case Fill:
+        out << qint32(record.rect.x()) << qint32(record.rect.y()) << qint32(record.rect.width())
+            << qint32(record.rect.height()) << quint32(record.color);
+        break;
+    case Block: {
+        QImage block = record.block.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+        out << qint32(record.rect.x()) << qint32(record.rect.y()) << qint32(block.width()) << qint32(block.height());
+        for (int y = 0; y < block.height(); ++y) {
+            out.writeRawData(reinterpret_cast<const char*>(block.constScanLine(y)), block.width() * sizeof(QRgb));
+        }
+        break;
+    }
+    case Checkpoint:
+        break;
+    }
+
+    QByteArray framed;
+    QDataStream frame(&framed, QIODevice::WriteOnly);
+    frame.setByteOrder(QDataStream::LittleEndian);
+    frame << quint32(payload.size());
+    framed.append(payload);
+    return framed;
+}
+
+// Pending records are taken in batches. Only the newest checkpoint of a batch
+// is written, and records queued before it are already part of that state.
+// If that checkpoint can't be saved the old one stays, so the whole batch
+// goes to the log as usual.
+void AutosaveJournal::run() {
+    QFile log(sessionDir + "/" + LogName);
+    log.open(QIODevice::WriteOnly | QIODevice::Append);
+
+    forever {
+        QVector<Record> batch;
+        {
+            QMutexLocker locker(&mutex);
+            while (queue.isEmpty() && !stopping) {
+                wakeup.wait(&mutex);
+            }
+            if (queue.isEmpty()) break;
+            batch.swap(queue);
+        }
+
+        int first = 0;
+        for (int i = batch.size() - 1; i >= 0; --i) {
+            if (batch[i].type == Checkpoint) {
+                const QString path = sessionDir + "/" + CheckpointName;
+                ProjectFile checkpointFile;
+                if (checkpointFile.save(path, batch[i].state)) {
+                    log.resize(0);
+                    first = i + 1;
+                } else {
+                    emit checkpointFailed(path, checkpointFile.errorString());
+                }
+                break;
+            }
+        }
+
+        QByteArray out;
+        for (int i = first; i < batch.size(); ++i) {
+            out.append(serialize(batch[i]));
+        }
+        if (!out.isEmpty()) {
+            log.write(out);
+            log.flush();
+        }
+    }
+}
+
+QString AutosaveJournal::findRecoverableSession() {
+    QDir root(autosaveRoot());
+    const QStringList sessions = root.entryList(QDir::Dirs | QDir::NoDotAndDotDot, QDir::Name | QDir::Reversed);
+    for (const QString& name : sessions) {
+        QString dir = root.filePath(name);
+        if (!QFile::exists(dir + "/" + CheckpointName)) continue;
+        QLockFile sessionLock(dir + "/" + LockName);
+        sessionLock.setStaleLockTime(0);
+        if (sessionLock.tryLock(0)) {
+            return dir;
+        }
+    }
+    return QString();
+}
+
+void AutosaveJournal::discardStaleSessions() {
+    QDir root(autosaveRoot());
+    const QStringList sessions = root.entryList(QDir::Dirs | QDir::NoDotAndDotDot);
+    for (const QString& name : sessions) {
+        QString dir = root.filePath(name);
+        QScopedPointer<QLockFile> sessionLock(new QLockFile(dir + "/" + LockName));
+        sessionLock->setStaleLockTime(0);
+        if (sessionLock->tryLock(0)) {
+            sessionLock.reset();
+            QDir(dir).removeRecursively();
+        }
+    }
+}
+
+bool AutosaveJournal::replay(const QString& dir, ProjectState& state, QString& error) {
+    ProjectFile checkpointFile;
+    if (!checkpointFile.load(dir + "/" + CheckpointName, state)) {
+        error = checkpointFile.errorString();
+        return false;
+    }
+
+    LayerStack stack;
+    stack.resize(state.width, state.height, state.storage);
+    stack.setLayers(state.layers);
+
+    QFile log(dir + "/" + LogName);
+    if (log.open(QIODevice::ReadOnly)) {
+        const QByteArray data = log.readAll();
+        int offset = 0;
+        // A crash can leave a partially written record at the end; stop there.
+        while (offset + 4 <= data.size()) {
+            quint32 length;
+            QDataStream header(data.mid(offset, 4));
+            header.setByteOrder(QDataStream::LittleEndian);
+            header >> length;
+            if (offset + 4 + qint64(length) > data.size()) break;
+
+            QDataStream in(data.mid(offset + 4, length));
+            in.setByteOrder(QDataStream::LittleEndian);
+            offset += 4 + length;
+
+            quint8 type;
+            qint32 layer;
+            in >> type >> layer;
+            if (layer < 0 || layer >= stack.layerCount()) continue;
+            stack.setCurrentIndex(layer);
+
+            if (type == Spans) {
+                qint32 count;
+                in >> count;
+                for (int i = 0; i < count && in.status() == QDataStream::Ok; ++i) {
+                    qint32 x, y, length;
+                    quint32 color;
+                    in >> x >> y >> length >> color;
+                    stack.fillRect(QRect(x, y, length, 1), QColor::fromRgba(color));
+                }
+            } else if (type == Fill) {
+                qint32 x, y, w, h;
+                quint32 color;
+                in >> x >> y >> w >> h >> color;
+                stack.fillRect(QRect(x, y, w, h), QColor::fromRgba(color));
+            } else if (type == Block) {
+                qint32 x, y, w, h;
+                in >> x >> y >> w >> h;
+                if (w <= 0 || h <= 0) continue;
+                QImage block(w, h, QImage::Format_ARGB32_Premultiplied);
+                for (int row = 0; row < h; ++row) {
+                    in.readRawData(reinterpret_cast<char*>(block.scanLine(row)), w * sizeof(QRgb));
+                }
+                if (in.status() == QDataStream::Ok) {
+                    stack.pasteImage(block, QPoint(x, y));
+                }
+            }
+        }
+    }
+
+    state.layers = stack.layers();
+    state.history.clear();
+    return true;
+}
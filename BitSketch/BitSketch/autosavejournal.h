@@ -0,0 +1,86 @@
+#ifndef AUTOSAVEJOURNAL_H
+#define AUTOSAVEJOURNAL_H
+
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QLockFile>
+#include <QScopedPointer>
+#include <QVector>
+#include <QImage>
+#include <QRect>
+#include "projectfile.h"
+
+// A run of cells on one row set to one colour.
+struct SpanWrite {
+    qint32 x;
+    qint32 y;
+    qint32 length;
+    QRgb color; // unpremultiplied, 0 erases
+};
+
+// Append-only log of editor operations for crash recovery. The GUI thread
+// only queues records; a background thread writes them to
+// <session>/journal.log. A checkpoint writes the whole document to
+// <session>/checkpoint.bsk and truncates the log, so recovery is "load the
+// checkpoint, replay the log". Logged operations are absolute writes, which
+// makes replaying them over a checkpoint that already contains them harmless;
+// anything else (resizes, layer changes, undo) is recorded as a checkpoint.
+class AutosaveJournal : public QThread {
+    Q_OBJECT
+
+public:
+    explicit AutosaveJournal(QObject* parent = nullptr);
+    ~AutosaveJournal();
+
+    void startSession();
+    void finishSession();
+
+    void recordSpans(int layer, const QVector<SpanWrite>& spans);
+    void recordFill(int layer, const QRect& rect, QRgb color);
+    void recordBlock(int layer, const QPoint& topLeft, const QImage& block);
+    void checkpoint(ProjectState state);
+    bool hasUncheckpointedOperations() const { return operationsSinceCheckpoint > 0; }
+
+    static QString findRecoverableSession();
+    static void discardStaleSessions();
+    static bool replay(const QString& sessionDir, ProjectState& state, QString& error);
+
+signals:
+    void checkpointFailed(const QString& path, const QString& error);
+
+protected:
+    void run() override;
+
+private:
+    enum RecordType : quint8 {
+        Fill = 2,
+        Block = 3,
+        Checkpoint = 4,
+        Spans = 5
+    };
+
+    struct Record {
+        RecordType type;
+        qint32 layer;
+        QRect rect;
+        QRgb color;
+        QVector<SpanWrite> spans;
+        QImage block;
+        ProjectState state;
+    };
+
+    void enqueue(const Record& record);
+    static QString autosaveRoot();
+    static QByteArray serialize(const Record& record);
+
+    QString sessionDir;
+    QScopedPointer<QLockFile> lock;
+    QMutex mutex;
+    QWaitCondition wakeup;
+    QVector<Record> queue;
+    bool stopping;
+    int operationsSinceCheckpoint;
+};
+
+#endif // AUTOSAVEJOURNAL_H
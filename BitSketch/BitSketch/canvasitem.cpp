@@ -0,0 +1,107 @@
+#include "canvasitem.h"
+#include "rgb565.h"
+#include <QPainter>
+#include <QStyleOptionGraphicsItem>
+#include <QtMath>
+
+namespace {
+
+// Cell borders are drawn only once cells are big enough to tell apart.
+const int MinGridCellSize = 4;
+
+// The colour the display will show once color is truncated to RGB565.
+inline QRgb previewColor(QRgb color) {
+    return rgb565Lut()[toRgb565(color)];
+}
+
+} // namespace
+
+CanvasItem::CanvasItem(const TiledImage* image, int cellSize, QGraphicsItem* parent)
+    : QGraphicsItem(parent), image(image), cellSize(cellSize), targetPreview(false) {
+    setFlag(QGraphicsItem::ItemUsesExtendedStyleOption);
+}
+
+void CanvasItem::setCellSize(int size) {
+    prepareGeometryChange();
+    cellSize = size;
+}
+
+void CanvasItem::updateCells(const QRect& cells) {
+    update(QRectF(cells.x() * cellSize, cells.y() * cellSize, cells.width() * cellSize, cells.height() * cellSize));
+}
+
+// An RGB565 composite already is the export format, so there is nothing to
+// convert.
+void CanvasItem::setTargetPreview(bool enabled) {
+    enabled = enabled && image->format() != QImage::Format_RGB16;
+    if (targetPreview == enabled) return;
+    targetPreview = enabled;
+    previewTiles.clear();
+    previewKeys.clear();
+    update();
+}
+
+const QImage& CanvasItem::previewTile(int index) {
+    if (previewTiles.size() != image->tileCount()) {
+        previewTiles = QVector<QImage>(image->tileCount());
+        previewKeys = QVector<qint64>(image->tileCount(), 0);
+    }
+    const QImage& source = image->tile(index);
+    if (previewKeys[index] != source.cacheKey()) {
+        QImage converted(source.size(), QImage::Format_RGB32);
+        for (int y = 0; y < source.height(); ++y) {
+            const QRgb* in = reinterpret_cast<const QRgb*>(source.constScanLine(y));
+            QRgb* out = reinterpret_cast<QRgb*>(converted.scanLine(y));
+            for (int x = 0; x < source.width(); ++x) {
+                out[x] = previewColor(in[x]);
+            }
+        }
+        previewTiles[index] = converted;
+        previewKeys[index] = source.cacheKey();
+    }
+    return previewTiles[index];
+}
+
+QRectF CanvasItem::boundingRect() const {
+    return QRectF(0, 0, image->width() * cellSize, image->height() * cellSize);
+}
+
+void CanvasItem::paint(QPainter* painter, const QStyleOptionGraphicsItem* option, QWidget* widget) {
+    Q_UNUSED(widget);
+    const QRectF exposed = option->exposedRect & boundingRect();
+    if (exposed.isEmpty()) return;
+
+    const QRect cells = QRect(QPoint(qFloor(exposed.left() / cellSize), qFloor(exposed.top() / cellSize)),
+                              QPoint(qCeil(exposed.right() / cellSize) - 1, qCeil(exposed.bottom() / cellSize) - 1))
+                        & image->rect();
+    if (cells.isEmpty()) return;
+
+    const int size = TiledImage::TileSize;
+    for (int ty = cells.top() / size; ty <= cells.bottom() / size; ++ty) {
+        for (int tx = cells.left() / size; tx <= cells.right() / size; ++tx) {
+            const int index = ty * image->tileColumns() + tx;
+            const QRect tile = image->tileRect(index);
+            const QRectF target(tile.x() * cellSize, tile.y() * cellSize, tile.width() * cellSize, tile.height() * cellSize);
+            if (image->isSolid(index)) {
+                const uint value = image->fillValue(index);
+                const QRgb color = image->format() == QImage::Format_RGB16 ? fromRgb565(value) : value;
+                painter->fillRect(target, QColor(targetPreview ? previewColor(color) : color));
+            } else {
+                painter->drawImage(target, targetPreview ? previewTile(index) : image->tile(index));
+            }
+        }
+    }
+
+    if (cellSize < MinGridCellSize) return;
+    painter->setPen(QPen(Qt::black, 0));
+    const qreal left = cells.left() * cellSize;
+    const qreal right = (cells.right() + 1) * cellSize;
+    const qreal top = cells.top() * cellSize;
+    const qreal bottom = (cells.bottom() + 1) * cellSize;
+    for (int x = cells.left(); x <= cells.right() + 1; ++x) {
+        painter->drawLine(QLineF(x * cellSize, top, x * cellSize, bottom));
+    }
+    for (int y = cells.top(); y <= cells.bottom() + 1; ++y) {
+        painter->drawLine(QLineF(left, y * cellSize, right, y * cellSize));
+    }
+}
@@ -0,0 +1,37 @@
+#ifndef CANVASITEM_H
+#define CANVASITEM_H
+
+#include <QGraphicsItem>
+#include "tiledimage.h"
+
+// Scene item that draws a tiled composite scaled by the cell size. Only the
+// tiles under the exposed rectangle are painted; a solid tile is a single
+// fillRect, so the cost of a repaint follows the visible area rather than the
+// canvas size.
+//
+// With the target preview on, a 32-bit composite is shown as it will come
+// out of the RGB565 export. Converted tiles are cached by the source tile's
+// cacheKey(), so only tiles painted since the last repaint are converted
+// again.
+class CanvasItem : public QGraphicsItem {
+public:
+    explicit CanvasItem(const TiledImage* image, int cellSize, QGraphicsItem* parent = nullptr);
+
+    void setCellSize(int size);
+    void updateCells(const QRect& cells);
+    void setTargetPreview(bool enabled);
+
+    QRectF boundingRect() const override;
+    void paint(QPainter* painter, const QStyleOptionGraphicsItem* option, QWidget* widget) override;
+
+private:
+    const QImage& previewTile(int index);
+
+    const TiledImage* image;
+    int cellSize;
+    bool targetPreview;
+    QVector<QImage> previewTiles;
+    QVector<qint64> previewKeys;
+};
+
+#endif // CANVASITEM_H
@@ -0,0 +1,11 @@
+#include "canvasview.h"
+#include <QElapsedTimer>
+
+CanvasView::CanvasView(QGraphicsScene* scene, QWidget* parent) : QGraphicsView(scene, parent) {}
+
+void CanvasView::paintEvent(QPaintEvent* event) {
+    QElapsedTimer timer;
+    timer.start();
+    QGraphicsView::paintEvent(event);
+    emit painted(timer.nsecsElapsed());
+}
@@ -0,0 +1,21 @@
+#ifndef CANVASVIEW_H
+#define CANVASVIEW_H
+
+#include <QGraphicsView>
+
+// The editor's view. Reports how long each repaint of the viewport took, so
+// the performance HUD can show paint time without intercepting the paint.
+class CanvasView : public QGraphicsView {
+    Q_OBJECT
+
+public:
+    explicit CanvasView(QGraphicsScene* scene, QWidget* parent = nullptr);
+
+signals:
+    void painted(qint64 paintNs);
+
+protected:
+    void paintEvent(QPaintEvent* event) override;
+};
+
+#endif // CANVASVIEW_H
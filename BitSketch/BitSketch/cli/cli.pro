@@ -0,0 +1,18 @@
+QT       += core gui
+QT       -= widgets
+
+CONFIG += c++11 console
+CONFIG -= app_bundle
+TARGET = bitsketch-cli
+
+include(../core/core.pri)
+
+SRC = $$PWD/..
+
+SOURCES += \
+    $$SRC/climain.cpp
+
+# Default rules for deployment.
+qnx: target.path = /tmp/$${TARGET}/bin
+else: unix:!android: target.path = /opt/$${TARGET}/bin
+!isEmpty(target.path): INSTALLS += target
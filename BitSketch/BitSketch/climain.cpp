@@ -0,0 +1,16 @@
+#include "commandline.h"
+#include "trace.h"
+#include <QCoreApplication>
+
+// bitsketch-cli: the headless modes without QtWidgets, so build servers need
+// neither a display nor the widget libraries.
+int main(int argc, char* argv[]) {
+    Trace::startFromEnvironment(argc, argv);
+    int result;
+    {
+        QCoreApplication app(argc, argv);
+        result = runCommandLine(app);
+    }
+    Trace::finish();
+    return result;
+}
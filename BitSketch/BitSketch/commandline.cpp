@@ -0,0 +1,211 @@
+#include "commandline.h"
+#include "assetbuild.h"
+#include "assetwatcher.h"
+#include "hexarrayimport.h"
+#include "hexexport.h"
+#include "imagestream.h"
+#include "pngwriter.h"
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QTextStream>
+#include <QThread>
+#include <cstdio>
+#include <cstring>
+
+namespace {
+
+const int ReadBlockBytes = 1 << 20;
+
+const char* const HeadlessOptions[] = {"--watch", "--build", "--import-hex", "--stream"};
+
+QTextStream& console() {
+    static QTextStream out(stdout);
+    return out;
+}
+
+QTextStream& errors() {
+    static QTextStream out(stderr);
+    return out;
+}
+
+int runWatch(QCoreApplication& app, const QString& sourceDir, const QString& outputDir) {
+    AssetWatcher watcher(sourceDir, outputDir);
+    QObject::connect(&watcher, &AssetWatcher::converted,
+                     [](const QString& source, const QString& output, qint64 elapsedMs) {
+                         console() << source << " -> " << output << " (" << elapsedMs << " ms)" << Qt::endl;
+                     });
+    QObject::connect(&watcher, &AssetWatcher::failed, [](const QString& source, const QString& reason) {
+        errors() << source << ": " << reason << Qt::endl;
+    });
+    if (!watcher.start()) {
+        errors() << watcher.errorString() << Qt::endl;
+        return 1;
+    }
+    console() << "Watching " << sourceDir << ", writing headers to " << outputDir << Qt::endl;
+    return app.exec();
+}
+
+int runBuild(const QString& manifest, const QString& outputDir, int threadCount) {
+    QElapsedTimer timer;
+    timer.start();
+    AssetBuild build;
+    if (!build.loadManifest(manifest) || !build.build(outputDir, threadCount)) {
+        errors() << build.errorString() << Qt::endl;
+        return 1;
+    }
+    console() << build.assets().size() << " assets: " << build.convertedCount() << " converted, "
+              << build.upToDateCount() << " up to date; output " << (build.outputChanged() ? "updated" : "unchanged")
+              << " (" << timer.elapsed() << " ms)" << Qt::endl;
+    return 0;
+}
+
+int runImportHex(const QString& input, const QString& output, int width) {
+    QElapsedTimer timer;
+    timer.start();
+    HexArrayImport importer;
+    if (!importer.load(input, width)) {
+        errors() << input << ": " << importer.errorString() << Qt::endl;
+        return 1;
+    }
+    const TiledImage image = TiledImage::fromImage(importer.toImage(), importer.width(), importer.height(),
+                                                   QImage::Format_RGB32);
+    PngWriter writer;
+    if (!writer.write(output, image)) {
+        errors() << output << ": " << writer.errorString() << Qt::endl;
+        return 1;
+    }
+    console() << input << " -> " << output << " (" << importer.width() << "x" << importer.height() << ", "
+              << timer.elapsed() << " ms)" << Qt::endl;
+    return 0;
+}
+
+// Reads concatenated images from stdin and writes one array per image to
+// stdout. Every image is converted as soon as its last byte has arrived, and
+// reads grow with the pending image so framing a large one stays linear.
+int runStream(const QString& name) {
+    QFile input;
+    QFile output;
+    if (!input.open(stdin, QIODevice::ReadOnly | QIODevice::Unbuffered)
+        || !output.open(stdout, QIODevice::WriteOnly | QIODevice::Unbuffered)) {
+        errors() << "Can't open standard input and output." << Qt::endl;
+        return 1;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    const QString symbol = assetSymbolName(name);
+    QByteArray pending;
+    int count = 0;
+    bool atEnd = false;
+    for (;;) {
+        qint64 length = encodedImageLength(reinterpret_cast<const uchar*>(pending.constData()), pending.size());
+        if (length <= 0 && !atEnd) {
+            const int start = pending.size();
+            const int block = qMax(ReadBlockBytes, start);
+            pending.resize(start + block);
+            const qint64 read = input.read(pending.data() + start, block);
+            pending.resize(start + int(qMax<qint64>(0, read)));
+            if (read < 0) {
+                errors() << "stdin: " << input.errorString() << Qt::endl;
+                return 1;
+            }
+            atEnd = read == 0;
+            continue;
+        }
+        if (pending.isEmpty()) break;
+        // Formats that can't be framed take the rest of the input.
+        if (length <= 0) length = pending.size();
+
+        const QImage image = QImage::fromData(reinterpret_cast<const uchar*>(pending.constData()), int(length));
+        if (image.isNull()) {
+            errors() << "stdin: image " << count + 1 << " (" << length << " bytes) can't be decoded." << Qt::endl;
+            return 1;
+        }
+        const QString imageSymbol = count == 0 ? symbol : symbol + "_" + QString::number(count);
+        if (!writeHexArray(output, image, imageSymbol)) {
+            errors() << "stdout: " << output.errorString() << Qt::endl;
+            return 1;
+        }
+        ++count;
+        pending.remove(0, int(length));
+    }
+
+    if (count == 0) {
+        errors() << "stdin: no image." << Qt::endl;
+        return 1;
+    }
+    errors() << count << (count == 1 ? " image" : " images") << " (" << timer.elapsed() << " ms)" << Qt::endl;
+    return 0;
+}
+
+} // namespace
+
+bool wantsCommandLine(int argc, char* argv[]) {
+    for (int i = 1; i < argc; ++i) {
+        for (const char* option : HeadlessOptions) {
+            if (strncmp(argv[i], option, strlen(option)) == 0) return true;
+        }
+    }
+    return false;
+}
+
+int runCommandLine(QCoreApplication& app) {
+    QCommandLineParser parser;
+    parser.setApplicationDescription("BitSketch image to RGB565 hex converter");
+    parser.addHelpOption();
+    QCommandLineOption watchOption("watch", "Convert every image in <dir> and keep the headers up to date.", "dir");
+    QCommandLineOption buildOption("build", "Build every asset listed in a JSON or INI <manifest>.", "manifest");
+    QCommandLineOption importHexOption("import-hex", "Convert an RGB565 hex array <file> back to a PNG.", "file");
+    QCommandLineOption outputOption({"o", "output"},
+                                    "Output directory (default: <dir>/generated for --watch, the manifest's directory for --build); "
+                                    "output file for --import-hex (default: <file> with a .png suffix).",
+                                    "path");
+    QCommandLineOption streamOption("stream", "Convert images piped to stdin and write the arrays to stdout.");
+    QCommandLineOption symbolOption("symbol", "Array name for --stream; later images get _1, _2, ... appended.", "name",
+                                    "stdin");
+    QCommandLineOption widthOption("width", "Image width for --import-hex when the array doesn't give it.", "n", "0");
+    QCommandLineOption jobsOption({"j", "jobs"}, "Number of worker threads for --build.", "n",
+                                  QString::number(QThread::idealThreadCount()));
+    parser.addOption(watchOption);
+    parser.addOption(buildOption);
+    parser.addOption(importHexOption);
+    parser.addOption(outputOption);
+    parser.addOption(widthOption);
+    parser.addOption(streamOption);
+    parser.addOption(symbolOption);
+    QCommandLineOption traceOption("trace", "Write a Chrome trace-event JSON file (also BITSKETCH_TRACE).", "file");
+    parser.addOption(jobsOption);
+    parser.addOption(traceOption);
+    parser.process(app);
+
+    if (parser.isSet(watchOption)) {
+        const QString sourceDir = parser.value(watchOption);
+        const QString outputDir = parser.isSet(outputOption) ? parser.value(outputOption) : sourceDir + "/generated";
+        return runWatch(app, sourceDir, outputDir);
+    }
+
+    if (parser.isSet(buildOption)) {
+        const QString manifest = parser.value(buildOption);
+        const QString outputDir = parser.isSet(outputOption) ? parser.value(outputOption) : QFileInfo(manifest).absolutePath();
+        return runBuild(manifest, outputDir, parser.value(jobsOption).toInt());
+    }
+
+    if (parser.isSet(streamOption)) {
+        return runStream(parser.value(symbolOption));
+    }
+
+    if (parser.isSet(importHexOption)) {
+        const QString input = parser.value(importHexOption);
+        const QFileInfo info(input);
+        const QString output = parser.isSet(outputOption) ? parser.value(outputOption)
+                                                          : info.dir().filePath(info.completeBaseName() + ".png");
+        return runImportHex(input, output, parser.value(widthOption).toInt());
+    }
+
+    parser.showHelp(1);
+    return 1;
+}
@@ -0,0 +1,11 @@
+#ifndef COMMANDLINE_H
+#define COMMANDLINE_H
+
+class QCoreApplication;
+
+// Headless modes (watch, build, ...). They run on a QCoreApplication, so they work
+// without a display.
+bool wantsCommandLine(int argc, char* argv[]);
+int runCommandLine(QCoreApplication& app);
+
+#endif // COMMANDLINE_H
@@ -0,0 +1,11 @@
+# Included by projects that link bitsketch-core. PNG export deflates with
+# zlib directly, so zlib comes along with the static library.
+INCLUDEPATH += $$PWD/..
+
+CORE_OUT = $$OUT_PWD/../core
+win32:CONFIG(release, debug|release): CORE_OUT = $$CORE_OUT/release
+else:win32:CONFIG(debug, debug|release): CORE_OUT = $$CORE_OUT/debug
+
+LIBS += -L$$CORE_OUT -lbitsketch-core -lz
+win32-msvc*: PRE_TARGETDEPS += $$CORE_OUT/bitsketch-core.lib
+else: PRE_TARGETDEPS += $$CORE_OUT/libbitsketch-core.a
@@ -0,0 +1,54 @@
+QT       += core gui
+QT       -= widgets
+
+TEMPLATE = lib
+CONFIG += c++11 staticlib
+TARGET = bitsketch-core
+
+SRC = $$PWD/..
+INCLUDEPATH += $$SRC
+
+SOURCES += \
+    $$SRC/assetbuild.cpp \
+    $$SRC/assetwatcher.cpp \
+    $$SRC/autosavejournal.cpp \
+    $$SRC/commandline.cpp \
+    $$SRC/framedelta.cpp \
+    $$SRC/framestore.cpp \
+    $$SRC/hexarrayimport.cpp \
+    $$SRC/hexexport.cpp \
+    $$SRC/hexexportfile.cpp \
+    $$SRC/imagestream.cpp \
+    $$SRC/layerstack.cpp \
+    $$SRC/pixelbuffer.cpp \
+    $$SRC/pngwriter.cpp \
+    $$SRC/projectfile.cpp \
+    $$SRC/rawframebufferimport.cpp \
+    $$SRC/savequeue.cpp \
+    $$SRC/tiledimage.cpp \
+    $$SRC/tileset.cpp \
+    $$SRC/trace.cpp \
+    $$SRC/workpool.cpp
+
+HEADERS += \
+    $$SRC/assetbuild.h \
+    $$SRC/assetwatcher.h \
+    $$SRC/autosavejournal.h \
+    $$SRC/commandline.h \
+    $$SRC/framedelta.h \
+    $$SRC/framestore.h \
+    $$SRC/hexarrayimport.h \
+    $$SRC/hexexport.h \
+    $$SRC/hexexportfile.h \
+    $$SRC/imagestream.h \
+    $$SRC/layerstack.h \
+    $$SRC/pixelbuffer.h \
+    $$SRC/pngwriter.h \
+    $$SRC/projectfile.h \
+    $$SRC/rawframebufferimport.h \
+    $$SRC/rgb565.h \
+    $$SRC/savequeue.h \
+    $$SRC/tiledimage.h \
+    $$SRC/tileset.h \
+    $$SRC/trace.h \
+    $$SRC/workpool.h
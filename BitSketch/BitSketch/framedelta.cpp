@@ -0,0 +1,196 @@
+#include "framedelta.h"
+#include "rgb565.h"
+#include <QFile>
+#include <cstring>
+
+FrameDelta::FrameDelta() : width(0), height(0) {}
+
+QVector<quint16> FrameDelta::toRgb565Pixels(const QImage& frame) {
+    const QImage source = frame.convertToFormat(QImage::Format_RGB32);
+    QVector<quint16> out(source.width() * source.height());
+    quint16* p = out.data();
+    for (int y = 0; y < source.height(); ++y) {
+        const QRgb* line = reinterpret_cast<const QRgb*>(source.constScanLine(y));
+        for (int x = 0; x < source.width(); ++x) {
+            *p++ = toRgb565(line[x]);
+        }
+    }
+    return out;
+}
+
+// Blocks of BlockSize x BlockSize pixels are compared first; runs of dirty
+// blocks in a block row become rects, which grow downwards while the row
+// below has a run with the same extent. Each rect is then shrunk to the
+// pixels that actually changed.
+QVector<QRect> FrameDelta::changedRects(const QVector<quint16>& before, const QVector<quint16>& after,
+                                        int width, int height) {
+    const int blocksX = (width + BlockSize - 1) / BlockSize;
+    const int blocksY = (height + BlockSize - 1) / BlockSize;
+    QVector<bool> dirty(blocksX * blocksY, false);
+
+    for (int y = 0; y < height; ++y) {
+        const quint16* a = before.constData() + y * width;
+        const quint16* b = after.constData() + y * width;
+        if (memcmp(a, b, width * sizeof(quint16)) == 0) continue;
+        bool* blockRow = dirty.data() + (y / BlockSize) * blocksX;
+        for (int bx = 0; bx < blocksX; ++bx) {
+            if (blockRow[bx]) continue;
+            const int x = bx * BlockSize;
+            const int count = qMin(BlockSize, width - x);
+            if (memcmp(a + x, b + x, count * sizeof(quint16)) != 0) {
+                blockRow[bx] = true;
+            }
+        }
+    }
+
+    QVector<QRect> blockRects;
+    QVector<int> open; // indices into blockRects that reached the previous block row
+    for (int by = 0; by < blocksY; ++by) {
+        QVector<int> stillOpen;
+        int bx = 0;
+        while (bx < blocksX) {
+            if (!dirty[by * blocksX + bx]) {
+                ++bx;
+                continue;
+            }
+            const int start = bx;
+            while (bx < blocksX && dirty[by * blocksX + bx]) ++bx;
+
+            int extended = -1;
+            for (int index : open) {
+                const QRect& rect = blockRects[index];
+                if (rect.left() == start && rect.right() == bx - 1) {
+                    extended = index;
+                    break;
+                }
+            }
+            if (extended >= 0) {
+                blockRects[extended].setBottom(by);
+            } else {
+                extended = blockRects.size();
+                blockRects.append(QRect(start, by, bx - start, 1));
+            }
+            stillOpen.append(extended);
+        }
+        open = stillOpen;
+    }
+
+    QVector<QRect> result;
+    result.reserve(blockRects.size());
+    for (const QRect& blocks : blockRects) {
+        const QRect area = QRect(blocks.left() * BlockSize, blocks.top() * BlockSize,
+                                 blocks.width() * BlockSize, blocks.height() * BlockSize)
+                               .intersected(QRect(0, 0, width, height));
+        int left = area.right() + 1, right = area.left() - 1, top = -1, bottom = -1;
+        for (int y = area.top(); y <= area.bottom(); ++y) {
+            const quint16* a = before.constData() + y * width;
+            const quint16* b = after.constData() + y * width;
+            for (int x = area.left(); x <= area.right(); ++x) {
+                if (a[x] != b[x]) {
+                    left = qMin(left, x);
+                    right = qMax(right, x);
+                    if (top < 0) top = y;
+                    bottom = y;
+                }
+            }
+        }
+        if (top >= 0) {
+            result.append(QRect(QPoint(left, top), QPoint(right, bottom)));
+        }
+    }
+    return result;
+}
+
+void FrameDelta::appendRect(const QVector<quint16>& frame, const QRect& rect) {
+    rects.append(rect);
+    for (int y = rect.top(); y <= rect.bottom(); ++y) {
+        const quint16* line = frame.constData() + y * width + rect.left();
+        pixels.append(QVector<quint16>(line, line + rect.width()));
+    }
+}
+
+void FrameDelta::setReference(const QImage& frame) {
+    width = frame.width();
+    height = frame.height();
+    previous = toRgb565Pixels(frame);
+}
+
+bool FrameDelta::addFrame(const QImage& frame) {
+    if (!previous.isEmpty() && frame.size() != QSize(width, height)) {
+        error = QString("Frame is %1x%2, expected %3x%4.")
+                    .arg(frame.width()).arg(frame.height()).arg(width).arg(height);
+        return false;
+    }
+
+    const QVector<quint16> current = toRgb565Pixels(frame);
+    frameStarts.append(rects.size());
+    if (previous.isEmpty()) {
+        width = frame.width();
+        height = frame.height();
+        appendRect(current, QRect(0, 0, width, height));
+    } else {
+        for (const QRect& rect : changedRects(previous, current, width, height)) {
+            appendRect(current, rect);
+        }
+    }
+    previous = current;
+    return true;
+}
+
+QByteArray FrameDelta::toHex(const QString& prefix) const {
+    const QByteArray p = prefix.toLatin1();
+    QVector<quint16> rectValues;
+    rectValues.reserve(rects.size() * 4);
+    for (const QRect& rect : rects) {
+        rectValues << quint16(rect.x()) << quint16(rect.y()) << quint16(rect.width()) << quint16(rect.height());
+    }
+
+    QByteArray out;
+    out.reserve(pixels.size() * 8 + rectValues.size() * 8 + 1024);
+    out += QString("// %1x%2, %3 frames, %4 rects, %5 pixels\n")
+               .arg(width).arg(height).arg(frameCount()).arg(rectCount()).arg(pixelCount())
+               .toLatin1();
+    out += QString("const uint16_t %1_width = %2;\n").arg(prefix).arg(width).toLatin1();
+    out += QString("const uint16_t %1_height = %2;\n").arg(prefix).arg(height).toLatin1();
+    out += QString("const uint16_t %1_frame_count = %2;\n").arg(prefix).arg(frameCount()).toLatin1();
+    out += "// x, y, w, h per rect; pixels of consecutive rects follow each other\n";
+    out += "const uint16_t " + p + "_delta_rects [] PROGMEM = {\n";
+    for (int i = 0; i < rects.size(); ++i) {
+        appendHexRow(out, rectValues.constData() + i * 4, 4);
+    }
+    out += "};\n";
+    out += "// Rects of frame i are [frame_rects[i], frame_rects[i + 1])\n";
+    out += "const uint32_t " + p + "_delta_frame_rects [] PROGMEM = {\n";
+    QStringList starts;
+    for (int start : frameStarts) {
+        starts.append(QString::number(start));
+    }
+    starts.append(QString::number(rects.size()));
+    out += starts.join(", ").toLatin1() + ",\n";
+    out += "};\n";
+    out += "const uint16_t " + p + "_delta_pixels [] PROGMEM = {\n";
+    int offset = 0;
+    for (const QRect& rect : rects) {
+        for (int y = 0; y < rect.height(); ++y) {
+            appendHexRow(out, pixels.constData() + offset, rect.width());
+            offset += rect.width();
+        }
+    }
+    out += "};\n";
+    return out;
+}
+
+bool FrameDelta::save(const QString& path) const {
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+        error = file.errorString();
+        return false;
+    }
+
+    const QByteArray out = toHex("epd_bitmap");
+    if (file.write(out) != out.size()) {
+        error = file.errorString();
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,45 @@
+#ifndef FRAMEDELTA_H
+#define FRAMEDELTA_H
+
+#include <QImage>
+#include <QRect>
+#include <QString>
+#include <QVector>
+
+// Partial-refresh export. Each frame is stored as the rectangles that differ
+// from the frame before it, in RGB565; the first frame (or any frame with no
+// reference) is stored whole. The device walks the rects of a frame in order,
+// taking w * h pixels for each from the pixel array.
+class FrameDelta {
+public:
+    static const int BlockSize = 8;
+
+    FrameDelta();
+
+    void setReference(const QImage& frame);
+    bool addFrame(const QImage& frame);
+    QByteArray toHex(const QString& prefix) const;
+    bool save(const QString& path) const;
+    QString errorString() const { return error; }
+
+    int frameCount() const { return frameStarts.size(); }
+    int rectCount() const { return rects.size(); }
+    int pixelCount() const { return pixels.size(); }
+
+    static QVector<quint16> toRgb565Pixels(const QImage& frame);
+    static QVector<QRect> changedRects(const QVector<quint16>& before, const QVector<quint16>& after,
+                                       int width, int height);
+
+private:
+    void appendRect(const QVector<quint16>& frame, const QRect& rect);
+
+    mutable QString error;
+    int width;
+    int height;
+    QVector<quint16> previous;
+    QVector<quint16> pixels;
+    QVector<QRect> rects;
+    QVector<int> frameStarts; // index of the first rect of each frame
+};
+
+#endif // FRAMEDELTA_H
@@ -0,0 +1,109 @@
+#include "framestore.h"
+#include <QSet>
+#include <cstring>
+
+FrameStore::FrameStore() : storeWidth(0), storeHeight(0) {}
+
+void FrameStore::reset(int width, int height, const QVector<Layer>& layers) {
+    storeWidth = width;
+    storeHeight = height;
+    frameList.clear();
+    tilePool.clear();
+    frameList.append(Frame());
+    storeFrame(0, layers, 0, QVector<QVector<Layer>>());
+}
+
+void FrameStore::setFrames(int width, int height, const QVector<Frame>& frames) {
+    storeWidth = width;
+    storeHeight = height;
+    frameList = frames;
+    tilePool.clear();
+    for (Frame& frame : frameList) {
+        for (Layer& layer : frame.layers) {
+            internTiles(layer.image);
+        }
+    }
+}
+
+// Returns the pooled tile with the same pixels, adding this one if it is new.
+QImage FrameStore::intern(const QImage& tile) {
+    const uint hash = qHashBits(tile.constBits(), tile.sizeInBytes());
+    for (auto it = tilePool.constFind(hash); it != tilePool.constEnd() && it.key() == hash; ++it) {
+        const QImage& candidate = it.value();
+        if (candidate.size() == tile.size()
+            && memcmp(candidate.constBits(), tile.constBits(), tile.sizeInBytes()) == 0) {
+            return candidate;
+        }
+    }
+    tilePool.insert(hash, tile);
+    return tile;
+}
+
+void FrameStore::internTiles(TiledImage& image) {
+    for (int t = 0; t < image.tileCount(); ++t) {
+        if (!image.isSolid(t)) image.setTile(t, intern(image.tile(t)));
+    }
+}
+
+void FrameStore::storeFrame(int index, const QVector<Layer>& layers, int currentLayer,
+                            const QVector<QVector<Layer>>& history) {
+    Frame frame;
+    frame.currentLayer = currentLayer;
+    frame.history = history;
+    frame.layers = layers;
+    for (Layer& layer : frame.layers) {
+        internTiles(layer.image);
+    }
+    frameList[index] = frame;
+    prune();
+}
+
+void FrameStore::insertFrame(int index, const Frame& frame) {
+    frameList.insert(index, frame);
+}
+
+void FrameStore::removeFrame(int index) {
+    if (frameList.size() <= 1) return;
+    frameList.remove(index);
+    prune();
+}
+
+QVector<Layer> FrameStore::expandFrame(int index) const {
+    return frameList[index].layers;
+}
+
+TiledImage FrameStore::compositeFrame(int index) const {
+    const QVector<Layer> layers = expandFrame(index);
+    LayerStack stack;
+    stack.resize(storeWidth, storeHeight, LayerStack::storageForFormat(layers.first().image.format()));
+    stack.setLayers(layers);
+    return stack.composite();
+}
+
+// Pool entries nobody else references any more are dropped.
+void FrameStore::prune() {
+    for (auto it = tilePool.begin(); it != tilePool.end();) {
+        if (it.value().isDetached()) {
+            it = tilePool.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+qint64 FrameStore::uniqueTileBytes() const {
+    qint64 bytes = 0;
+    QSet<qint64> seen;
+    for (const Frame& frame : frameList) {
+        for (const Layer& layer : frame.layers) {
+            for (int t = 0; t < layer.image.tileCount(); ++t) {
+                const QImage& tile = layer.image.tile(t);
+                if (!tile.isNull() && !seen.contains(tile.cacheKey())) {
+                    seen.insert(tile.cacheKey());
+                    bytes += tile.sizeInBytes();
+                }
+            }
+        }
+    }
+    return bytes;
+}
@@ -0,0 +1,52 @@
+#ifndef FRAMESTORE_H
+#define FRAMESTORE_H
+
+#include <QImage>
+#include <QMultiHash>
+#include <QVector>
+#include "layerstack.h"
+
+struct Frame {
+    QVector<Layer> layers; // tiles interned in the owning FrameStore
+    int currentLayer;
+    QVector<QVector<Layer>> history;
+};
+
+// Animation frames kept as tiled layers. Identical tiles, within a frame or
+// across frames, are interned to one implicitly shared QImage, so a sequence
+// of similar frames only pays for the tiles that actually differ; solid
+// tiles cost nothing at all.
+class FrameStore {
+public:
+    FrameStore();
+
+    void reset(int width, int height, const QVector<Layer>& layers);
+    int width() const { return storeWidth; }
+    int height() const { return storeHeight; }
+
+    int frameCount() const { return frameList.size(); }
+    const Frame& frame(int index) const { return frameList[index]; }
+    QVector<Frame> frames() const { return frameList; }
+    void setFrames(int width, int height, const QVector<Frame>& frames);
+
+    void storeFrame(int index, const QVector<Layer>& layers, int currentLayer,
+                    const QVector<QVector<Layer>>& history);
+    void insertFrame(int index, const Frame& frame);
+    void removeFrame(int index);
+    QVector<Layer> expandFrame(int index) const;
+    TiledImage compositeFrame(int index) const;
+
+    qint64 uniqueTileBytes() const;
+    void prune();
+
+private:
+    QImage intern(const QImage& tile);
+    void internTiles(TiledImage& image);
+
+    int storeWidth;
+    int storeHeight;
+    QVector<Frame> frameList;
+    QMultiHash<uint, QImage> tilePool;
+};
+
+#endif // FRAMESTORE_H
@@ -0,0 +1,186 @@
+#include "hexarrayimport.h"
+#include "rgb565.h"
+#include "trace.h"
+#include <QFile>
+#include <QRegularExpression>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+inline int hexDigitValue(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    c |= 0x20;
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return -1;
+}
+
+#if defined(__SSE2__)
+// Decodes two tokens in the layout BitSketch writes, "0xHHHH, " or
+// "0xHHHH,\n", from 16 bytes at once. Returns false, consuming nothing, when
+// the bytes are laid out any other way; newlines gets the positions (7, 15)
+// of line breaks as a bit mask.
+inline bool decodeTokenPair(const char* p, quint16* out, int* newlines) {
+    const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    const __m128i punctuation = _mm_setr_epi8('0', 'x', 0, 0, 0, 0, ',', 0, '0', 'x', 0, 0, 0, 0, ',', 0);
+    if ((_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, punctuation)) & 0x4343) != 0x4343) return false;
+
+    const int breaks = _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, _mm_set1_epi8('\n')));
+    const int spaces = _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, _mm_set1_epi8(' ')));
+    if (((breaks | spaces) & 0x8080) != 0x8080) return false;
+
+    const __m128i lower = _mm_or_si128(chunk, _mm_set1_epi8(0x20));
+    const __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(chunk, _mm_set1_epi8('0' - 1)),
+                                        _mm_cmplt_epi8(chunk, _mm_set1_epi8('9' + 1)));
+    const __m128i letter = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)),
+                                         _mm_cmplt_epi8(lower, _mm_set1_epi8('f' + 1)));
+    if ((_mm_movemask_epi8(_mm_or_si128(digit, letter)) & 0x3C3C) != 0x3C3C) return false;
+
+    // '0'-'9' -> 0-9; 'a'-'f' and 'A'-'F' have 1-6 in the low nibble.
+    const __m128i nibbles = _mm_add_epi8(_mm_and_si128(chunk, _mm_set1_epi8(0x0F)),
+                                         _mm_and_si128(letter, _mm_set1_epi8(9)));
+    alignas(16) uchar n[16];
+    _mm_store_si128(reinterpret_cast<__m128i*>(n), nibbles);
+    out[0] = quint16((n[2] << 12) | (n[3] << 8) | (n[4] << 4) | n[5]);
+    out[1] = quint16((n[10] << 12) | (n[11] << 8) | (n[12] << 4) | n[13]);
+    *newlines = breaks & 0x8080;
+    return true;
+}
+#endif
+
+} // namespace
+
+HexArrayImport::HexArrayImport()
+    : widthMissing(false), imageWidth(0), imageHeight(0), firstLineCount(-1) {}
+
+bool HexArrayImport::load(const QString& path, int width) {
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        error = file.errorString();
+        widthMissing = false;
+        return false;
+    }
+    return parse(file.readAll(), width);
+}
+
+bool HexArrayImport::parse(const QByteArray& text, int width) {
+    TRACE_SCOPE("HexArrayImport::parse");
+    error.clear();
+    widthMissing = false;
+    imageWidth = imageHeight = 0;
+    firstLineCount = -1;
+    pixels.clear();
+
+    // Files without an initializer list are taken as bare value rows.
+    const int open = text.indexOf('{');
+    const char* begin = text.constData() + (open < 0 ? 0 : open + 1);
+    pixels.reserve(int((text.constData() + text.size() - begin) / 8) + 1);
+    if (!tokenize(begin, text.constData() + text.size())) return false;
+    if (pixels.isEmpty()) {
+        error = "No pixel values found.";
+        return false;
+    }
+
+    if (width <= 0 && open > 0) {
+        static const QRegularExpression sizeComment("//\\s*(\\d+)\\s*x\\s*(\\d+)");
+        const QRegularExpressionMatch match = sizeComment.match(QString::fromLatin1(text.left(open)));
+        if (match.hasMatch() && match.captured(1).toLongLong() * match.captured(2).toLongLong() == pixels.size()) {
+            width = match.captured(1).toInt();
+        }
+    }
+    if (width <= 0 && firstLineCount > 0 && pixels.size() % firstLineCount == 0) {
+        width = firstLineCount;
+    }
+    if (width <= 0) {
+        widthMissing = true;
+        error = QString("Can't tell the width of %1 values; give it explicitly.").arg(pixels.size());
+        return false;
+    }
+    if (pixels.size() % width != 0) {
+        error = QString("%1 values don't make rows of %2 pixels.").arg(pixels.size()).arg(width);
+        return false;
+    }
+    imageWidth = width;
+    imageHeight = pixels.size() / width;
+    return true;
+}
+
+// Values are hex (0x...) or decimal, separated by commas and whitespace;
+// comments are skipped and a '}' ends the array.
+bool HexArrayImport::tokenize(const char* p, const char* end) {
+    int line = 1;
+    while (p < end) {
+#if defined(__SSE2__)
+        quint16 pair[2];
+        int newlines;
+        if (end - p >= 16 && decodeTokenPair(p, pair, &newlines)) {
+            pixels.append(pair[0]);
+            if ((newlines & 0x80) && firstLineCount < 0) firstLineCount = pixels.size();
+            pixels.append(pair[1]);
+            if ((newlines & 0x8000) && firstLineCount < 0) firstLineCount = pixels.size();
+            line += ((newlines & 0x80) ? 1 : 0) + ((newlines & 0x8000) ? 1 : 0);
+            p += 16;
+            continue;
+        }
+#endif
+        const char c = *p;
+        if (c >= '0' && c <= '9') {
+            uint value = 0;
+            int digits = 0;
+            if (c == '0' && end - p > 2 && (p[1] | 0x20) == 'x' && hexDigitValue(p[2]) >= 0) {
+                p += 2;
+                for (int d; p < end && (d = hexDigitValue(*p)) >= 0 && digits <= 4; ++p, ++digits) {
+                    value = (value << 4) | d;
+                }
+            } else {
+                for (; p < end && *p >= '0' && *p <= '9' && digits <= 5; ++p, ++digits) {
+                    value = value * 10 + (*p - '0');
+                }
+            }
+            // C suffixes (0xffffU) are fine; more digits are not.
+            while (p < end && ((*p | 0x20) == 'u' || (*p | 0x20) == 'l')) ++p;
+            if (value > 0xFFFF || (p < end && (hexDigitValue(*p) >= 0 || (*p | 0x20) == 'x'))) {
+                error = QString("Line %1: value is not a 16-bit number.").arg(line);
+                return false;
+            }
+            pixels.append(quint16(value));
+        } else if (c == '\n') {
+            if (firstLineCount < 0 && !pixels.isEmpty()) firstLineCount = pixels.size();
+            ++line;
+            ++p;
+        } else if (c == ',' || c == ' ' || c == '\t' || c == '\r') {
+            ++p;
+        } else if (c == '/' && end - p > 1 && p[1] == '/') {
+            while (p < end && *p != '\n') ++p;
+        } else if (c == '/' && end - p > 1 && p[1] == '*') {
+            p += 2;
+            while (p < end && !(p[0] == '*' && end - p > 1 && p[1] == '/')) {
+                if (*p == '\n') ++line;
+                ++p;
+            }
+            p = qMin(p + 2, end);
+        } else if (c == '}') {
+            return true;
+        } else {
+            error = QString("Line %1: unexpected '%2' in the array.").arg(line).arg(QChar::fromLatin1(c));
+            return false;
+        }
+    }
+    return true;
+}
+
+QImage HexArrayImport::toImage() const {
+    if (imageWidth == 0) return QImage();
+    QImage image(imageWidth, imageHeight, QImage::Format_RGB32);
+    const QRgb* lut = rgb565Lut();
+    const quint16* in = pixels.constData();
+    for (int y = 0; y < imageHeight; ++y) {
+        QRgb* out = reinterpret_cast<QRgb*>(image.scanLine(y));
+        for (int x = 0; x < imageWidth; ++x) {
+            out[x] = lut[*in++];
+        }
+    }
+    return image;
+}
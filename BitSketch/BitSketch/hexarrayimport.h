@@ -0,0 +1,42 @@
+#ifndef HEXARRAYIMPORT_H
+#define HEXARRAYIMPORT_H
+
+#include <QByteArray>
+#include <QImage>
+#include <QString>
+#include <QVector>
+
+// Reads RGB565 C arrays back into an image: the epd_bitmap files BitSketch
+// and similar tools write ("const uint16_t name [] PROGMEM = {0xffff, ...};")
+// as well as the bare "0xffff, ...," rows of the editor's hex export. Only
+// the first array of a file is read.
+//
+// The width is taken from, in order: the caller, a "// WxH" comment in front
+// of the array, or the number of values on the array's first line when that
+// divides the total. needsWidth() tells when none of these worked.
+class HexArrayImport {
+public:
+    HexArrayImport();
+
+    bool load(const QString& path, int width = 0);
+    bool parse(const QByteArray& text, int width = 0);
+    QString errorString() const { return error; }
+    bool needsWidth() const { return widthMissing; }
+
+    int width() const { return imageWidth; }
+    int height() const { return imageHeight; }
+    const QVector<quint16>& values() const { return pixels; }
+    QImage toImage() const;
+
+private:
+    bool tokenize(const char* p, const char* end);
+
+    QString error;
+    bool widthMissing;
+    int imageWidth;
+    int imageHeight;
+    int firstLineCount;
+    QVector<quint16> pixels;
+};
+
+#endif // HEXARRAYIMPORT_H
@@ -0,0 +1,79 @@
+#include "hexexport.h"
+#include "rgb565.h"
+#include <QCryptographicHash>
+#include <QVector>
+
+// "epd_bitmap_" plus the name with anything that isn't valid in a C
+// identifier replaced by '_'.
+QString assetSymbolName(const QString& name) {
+    QString symbol = "epd_bitmap_";
+    for (QChar c : name) {
+        symbol += (c.isLetterOrNumber() && c.unicode() < 128) ? c : QChar('_');
+    }
+    return symbol;
+}
+
+namespace {
+
+const int StreamBlockBytes = 1 << 20;
+
+void appendHexHeader(QByteArray& out, const QImage& source, const QString& symbol, bool sizeComment = true) {
+    if (sizeComment) out += QString("// %1x%2\n").arg(source.width()).arg(source.height()).toLatin1();
+    out += QString("const uint16_t %1 [] PROGMEM = {\n").arg(symbol).toLatin1();
+}
+
+void appendHexImageRow(QByteArray& out, const QImage& source, int y, QVector<quint16>& row) {
+    const QRgb* line = reinterpret_cast<const QRgb*>(source.constScanLine(y));
+    for (int x = 0; x < source.width(); ++x) {
+        row[x] = toRgb565(line[x]);
+    }
+    appendHexRow(out, row.constData(), row.size());
+}
+
+} // namespace
+
+QByteArray imageToHexArray(const QImage& image, const QString& symbol) {
+    const QImage source = image.convertToFormat(QImage::Format_RGB32);
+    QByteArray out;
+    out.reserve(source.width() * source.height() * 8 + 256);
+    appendHexHeader(out, source, symbol);
+    QVector<quint16> row(source.width());
+    for (int y = 0; y < source.height(); ++y) {
+        appendHexImageRow(out, source, y, row);
+    }
+    out += "};\n";
+    return out;
+}
+
+// The same text as imageToHexArray(), written in blocks of about 1 MB so
+// that large images never exist as one string. The main window's export
+// leaves out the "// WxH" line.
+bool writeHexArray(QIODevice& out, const QImage& image, const QString& symbol, bool sizeComment) {
+    const QImage source = image.convertToFormat(QImage::Format_RGB32);
+    QByteArray block;
+    block.reserve(StreamBlockBytes + source.width() * 8 + 256);
+    appendHexHeader(block, source, symbol, sizeComment);
+    QVector<quint16> row(source.width());
+    for (int y = 0; y < source.height(); ++y) {
+        appendHexImageRow(block, source, y, row);
+        if (block.size() >= StreamBlockBytes) {
+            if (out.write(block) != block.size()) return false;
+            block.resize(0);
+        }
+    }
+    block += "};\n";
+    return out.write(block) == block.size();
+}
+
+// Hash of the decoded pixels, so re-saving a file without changing what it
+// shows (new metadata, different compression) does not count as a change.
+QByteArray imageContentHash(const QImage& image) {
+    const QImage source = image.convertToFormat(QImage::Format_RGB32);
+    QCryptographicHash hash(QCryptographicHash::Md5);
+    const qint32 size[] = {source.width(), source.height()};
+    hash.addData(reinterpret_cast<const char*>(size), sizeof(size));
+    for (int y = 0; y < source.height(); ++y) {
+        hash.addData(reinterpret_cast<const char*>(source.constScanLine(y)), source.width() * sizeof(QRgb));
+    }
+    return hash.result();
+}
@@ -0,0 +1,15 @@
+#ifndef HEXEXPORT_H
+#define HEXEXPORT_H
+
+#include <QByteArray>
+#include <QIODevice>
+#include <QImage>
+#include <QString>
+
+// Shared pieces of the batch exporters (watch mode, manifest builds).
+QString assetSymbolName(const QString& name);
+QByteArray imageToHexArray(const QImage& image, const QString& symbol);
+bool writeHexArray(QIODevice& out, const QImage& image, const QString& symbol, bool sizeComment = true);
+QByteArray imageContentHash(const QImage& image);
+
+#endif // HEXEXPORT_H
@@ -0,0 +1,132 @@
+#include "hexexportfile.h"
+#include "rgb565.h"
+#include "trace.h"
+#include <QFile>
+#include <QFileInfo>
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+// Tiles that still share their pixels (or are the same solid value) are
+// unchanged; anything else is compared row by row.
+bool sameTile(const TiledImage& a, const TiledImage& b, int index) {
+    if (a.isSolid(index) || b.isSolid(index)) {
+        return a.isSolid(index) && b.isSolid(index) && a.fillValue(index) == b.fillValue(index);
+    }
+    return a.tile(index).cacheKey() == b.tile(index).cacheKey();
+}
+
+} // namespace
+
+// An RGB565 composite is dumped as stored; a 32-bit one is converted.
+void readRgb565Line(const TiledImage& composite, int y, quint16* out, QVector<QRgb>& scratch) {
+    if (composite.format() == QImage::Format_RGB16) {
+        composite.readLine(0, y, composite.width(), out);
+        return;
+    }
+    scratch.resize(composite.width());
+    composite.readLine(0, y, composite.width(), scratch.data());
+    std::transform(scratch.constBegin(), scratch.constEnd(), out, toRgb565);
+}
+
+HexExportFile::HexExportFile() : lastPatchedRows(-1) {}
+
+bool HexExportFile::save(const QString& path, const TiledImage& composite) {
+    TRACE_SCOPE("HexExportFile::save");
+    error.clear();
+    lastPatchedRows = -1;
+    const bool ok = canPatch(path, composite) ? writePatch(path, composite) : writeFull(path, composite);
+    if (ok) {
+        remember(path, composite);
+    } else {
+        lastPath.clear();
+    }
+    return ok;
+}
+
+bool HexExportFile::canPatch(const QString& path, const TiledImage& composite) const {
+    if (path != lastPath || composite.size() != saved.size() || composite.format() != saved.format()) return false;
+    const QFileInfo info(path);
+    return info.exists() && info.lastModified() == lastModified
+           && info.size() == qint64(composite.width()) * composite.height() * EntryBytes;
+}
+
+void HexExportFile::remember(const QString& path, const TiledImage& composite) {
+    lastPath = path;
+    lastModified = QFileInfo(path).lastModified();
+    saved = composite;
+}
+
+// Written in binary mode: the patch offsets assume '\n' line ends.
+bool HexExportFile::writeFull(const QString& path, const TiledImage& composite) {
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        error = file.errorString();
+        return false;
+    }
+    QVector<quint16> line(composite.width());
+    QVector<QRgb> scratch;
+    QByteArray text;
+    for (int y = 0; y < composite.height(); ++y) {
+        readRgb565Line(composite, y, line.data(), scratch);
+        appendHexRow(text, line.constData(), composite.width());
+        if (text.size() >= (1 << 20)) {
+            file.write(text);
+            text.clear();
+        }
+    }
+    file.write(text);
+    file.close();
+    if (file.error() != QFileDevice::NoError) {
+        error = file.errorString();
+        return false;
+    }
+    return true;
+}
+
+// Each changed row is rewritten from the first to the last changed column,
+// with one positioned write straight to the file.
+bool HexExportFile::writePatch(const QString& path, const TiledImage& composite) {
+    const int width = composite.width();
+    QVector<int> first(composite.height(), width);
+    QVector<int> last(composite.height(), 0);
+    QByteArray current(TiledImage::TileSize * composite.bytesPerPixel(), Qt::Uninitialized);
+    QByteArray previous(current.size(), Qt::Uninitialized);
+    for (int t = 0; t < composite.tileCount(); ++t) {
+        if (sameTile(composite, saved, t)) continue;
+        const QRect rect = composite.tileRect(t);
+        const int bytes = rect.width() * composite.bytesPerPixel();
+        for (int y = rect.top(); y <= rect.bottom(); ++y) {
+            composite.readLine(rect.left(), y, rect.width(), current.data());
+            saved.readLine(rect.left(), y, rect.width(), previous.data());
+            if (memcmp(current.constData(), previous.constData(), bytes) == 0) continue;
+            first[y] = qMin(first[y], rect.left());
+            last[y] = qMax(last[y], rect.right() + 1);
+        }
+    }
+
+    lastPatchedRows = 0;
+    QFile file(path);
+    if (!file.open(QIODevice::ReadWrite | QIODevice::Unbuffered)) {
+        error = file.errorString();
+        return false;
+    }
+    QVector<quint16> line(width);
+    QVector<QRgb> scratch;
+    QByteArray text;
+    for (int y = 0; y < composite.height(); ++y) {
+        if (last[y] <= first[y]) continue;
+        readRgb565Line(composite, y, line.data(), scratch);
+        text.resize(0);
+        appendHexRow(text, line.constData() + first[y], last[y] - first[y]);
+        // appendHexRow ends its last entry with a line break.
+        if (last[y] < width) text[text.size() - 1] = ' ';
+        if (!file.seek((qint64(y) * width + first[y]) * EntryBytes) || file.write(text) != text.size()) {
+            error = file.errorString();
+            return false;
+        }
+        ++lastPatchedRows;
+    }
+    return true;
+}
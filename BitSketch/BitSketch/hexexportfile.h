@@ -0,0 +1,43 @@
+#ifndef HEXEXPORTFILE_H
+#define HEXEXPORTFILE_H
+
+#include <QDateTime>
+#include <QString>
+#include <QVector>
+#include "tiledimage.h"
+
+// The editor's plain hex export: one "0xXXXX, ..., 0xXXXX,\n" line per
+// canvas row. Every entry is 8 bytes, so pixel (x, y) always starts at byte
+// (y * width + x) * 8. Saving again to the same path at the same size only
+// writes the entries of rows that differ from the previous save, in place;
+// tiles the canvas has not touched since then still share their pixels with
+// the remembered snapshot and are skipped without being read. Anything else
+// (new path, new size, file changed on disk) is a full rewrite.
+// Like ProjectFile, an instance must only be used by one thread at a time.
+class HexExportFile {
+public:
+    static const int EntryBytes = 8;
+
+    HexExportFile();
+
+    bool save(const QString& path, const TiledImage& composite);
+    QString errorString() const { return error; }
+    int patchedRows() const { return lastPatchedRows; } // -1 after a full rewrite
+
+private:
+    bool canPatch(const QString& path, const TiledImage& composite) const;
+    bool writeFull(const QString& path, const TiledImage& composite);
+    bool writePatch(const QString& path, const TiledImage& composite);
+    void remember(const QString& path, const TiledImage& composite);
+
+    QString error;
+    QString lastPath;
+    QDateTime lastModified;
+    TiledImage saved;
+    int lastPatchedRows;
+};
+
+// Row y of an RGB16 or RGB32 composite as RGB565 values.
+void readRgb565Line(const TiledImage& composite, int y, quint16* out, QVector<QRgb>& scratch);
+
+#endif // HEXEXPORTFILE_H
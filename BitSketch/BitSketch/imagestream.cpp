@@ -0,0 +1,61 @@
+#include "imagestream.h"
+#include <cstring>
+
+namespace {
+
+quint32 bigEndian32(const uchar* p) {
+    return (quint32(p[0]) << 24) | (quint32(p[1]) << 16) | (quint32(p[2]) << 8) | p[3];
+}
+
+// Signature, then length/type/data/CRC chunks up to IEND.
+qint64 pngLength(const uchar* data, qint64 size) {
+    qint64 pos = 8;
+    while (pos + 8 <= size) {
+        const qint64 end = pos + 12 + bigEndian32(data + pos);
+        if (memcmp(data + pos + 4, "IEND", 4) == 0) return end <= size ? end : 0;
+        pos = end;
+    }
+    return 0;
+}
+
+// Marker segments up to EOI. Entropy-coded data after each SOS runs until
+// the next marker that isn't a stuffed 0xFF00 or a restart marker.
+qint64 jpegLength(const uchar* data, qint64 size) {
+    qint64 pos = 2;
+    while (pos + 1 < size) {
+        if (data[pos] != 0xFF) return -1;
+        const uchar marker = data[pos + 1];
+        if (marker == 0xFF) { // fill byte
+            ++pos;
+            continue;
+        }
+        if (marker == 0xD9) return pos + 2;
+        if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD7)) {
+            pos += 2;
+            continue;
+        }
+        if (pos + 4 > size) return 0;
+        pos += 2 + ((data[pos + 2] << 8) | data[pos + 3]);
+        if (marker != 0xDA) continue;
+        for (;; ++pos) {
+            if (pos + 1 >= size) return 0;
+            if (data[pos] == 0xFF && data[pos + 1] != 0x00 && !(data[pos + 1] >= 0xD0 && data[pos + 1] <= 0xD7)) break;
+        }
+    }
+    return 0;
+}
+
+} // namespace
+
+qint64 encodedImageLength(const uchar* data, qint64 size) {
+    static const uchar png[] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    if (size < 8) return 0;
+    if (memcmp(data, png, sizeof(png)) == 0) return pngLength(data, size);
+    if (data[0] == 0xFF && data[1] == 0xD8) return jpegLength(data, size);
+    if (data[0] == 'B' && data[1] == 'M') {
+        const qint64 length = data[2] | (data[3] << 8) | (data[4] << 16) | (quint32(data[5]) << 24);
+        if (length < 26) return -1;
+        return length <= size ? length : 0;
+    }
+    return -1;
+}
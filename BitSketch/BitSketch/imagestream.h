@@ -0,0 +1,14 @@
+#ifndef IMAGESTREAM_H
+#define IMAGESTREAM_H
+
+#include <QtGlobal>
+
+// Length of the encoded image at the start of data, for splitting a stream
+// of concatenated images (e.g. "cat *.png | bitsketch-cli --stream") without
+// decoding them. PNG, JPEG and BMP are framed from their own structure.
+// Returns the length once the whole image is in data, 0 while more bytes are
+// needed, and -1 for other formats, which can only be the last image of a
+// stream.
+qint64 encodedImageLength(const uchar* data, qint64 size);
+
+#endif // IMAGESTREAM_H
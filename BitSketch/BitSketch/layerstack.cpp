@@ -0,0 +1,602 @@
+#include "layerstack.h"
+#include "rgb565.h"
+#include <algorithm>
+#include <climits>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+inline int mul255(int a, int b) {
+    int t = a * b + 128;
+    return (t + (t >> 8)) >> 8;
+}
+
+// Premultiplied blend of one channel; the same formula is valid for alpha.
+template <BlendMode Mode>
+inline int blendChannel(int s, int d, int sa, int da) {
+    switch (Mode) {
+    case BlendMode::Multiply:
+        return qMin(255, mul255(s, d) + mul255(s, 255 - da) + mul255(d, 255 - sa));
+    case BlendMode::Screen:
+        return s + d - mul255(s, d);
+    case BlendMode::Add:
+        return qMin(255, s + d);
+    case BlendMode::Normal:
+    default:
+        return s + mul255(d, 255 - sa);
+    }
+}
+
+template <BlendMode Mode>
+inline void blendPixelsScalar(QRgb* dst, const QRgb* src, int count, int opacity) {
+    for (int i = 0; i < count; ++i) {
+        QRgb s = src[i];
+        if (qAlpha(s) == 0) continue;
+        if (opacity != 255) {
+            s = qRgba(mul255(qRed(s), opacity), mul255(qGreen(s), opacity),
+                      mul255(qBlue(s), opacity), mul255(qAlpha(s), opacity));
+        }
+        QRgb d = dst[i];
+        int sa = qAlpha(s);
+        int da = qAlpha(d);
+        dst[i] = qRgba(blendChannel<Mode>(qRed(s), qRed(d), sa, da),
+                       blendChannel<Mode>(qGreen(s), qGreen(d), sa, da),
+                       blendChannel<Mode>(qBlue(s), qBlue(d), sa, da),
+                       blendChannel<Mode>(sa, da, sa, da));
+    }
+}
+
+#if defined(__SSE2__)
+inline __m128i mul255Epi16(__m128i a, __m128i b) {
+    __m128i t = _mm_add_epi16(_mm_mullo_epi16(a, b), _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+}
+
+inline __m128i broadcastAlpha(__m128i x) {
+    return _mm_shufflehi_epi16(_mm_shufflelo_epi16(x, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+}
+
+// Two pixels widened to 16 bits per channel; results may exceed 255 and are
+// clamped by the final pack.
+template <BlendMode Mode>
+inline __m128i blendEpi16(__m128i s, __m128i d) {
+    const __m128i full = _mm_set1_epi16(255);
+    __m128i invSa = _mm_sub_epi16(full, broadcastAlpha(s));
+    switch (Mode) {
+    case BlendMode::Multiply: {
+        __m128i invDa = _mm_sub_epi16(full, broadcastAlpha(d));
+        return _mm_add_epi16(_mm_add_epi16(mul255Epi16(s, d), mul255Epi16(s, invDa)), mul255Epi16(d, invSa));
+    }
+    case BlendMode::Screen:
+        return _mm_sub_epi16(_mm_add_epi16(s, d), mul255Epi16(s, d));
+    case BlendMode::Add:
+        return _mm_add_epi16(s, d);
+    case BlendMode::Normal:
+    default:
+        return _mm_add_epi16(s, mul255Epi16(d, invSa));
+    }
+}
+
+template <BlendMode Mode>
+void blendRow(QRgb* dst, const QRgb* src, int count, int opacity) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i alpha = _mm_set1_epi16(static_cast<short>(opacity));
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i s8 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(s8, zero)) == 0xFFFF) continue;
+        __m128i d8 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i));
+
+        __m128i sLo = _mm_unpacklo_epi8(s8, zero);
+        __m128i sHi = _mm_unpackhi_epi8(s8, zero);
+        if (opacity != 255) {
+            sLo = mul255Epi16(sLo, alpha);
+            sHi = mul255Epi16(sHi, alpha);
+        }
+        __m128i rLo = blendEpi16<Mode>(sLo, _mm_unpacklo_epi8(d8, zero));
+        __m128i rHi = blendEpi16<Mode>(sHi, _mm_unpackhi_epi8(d8, zero));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_packus_epi16(rLo, rHi));
+    }
+    blendPixelsScalar<Mode>(dst + i, src + i, count - i, opacity);
+}
+#else
+template <BlendMode Mode>
+void blendRow(QRgb* dst, const QRgb* src, int count, int opacity) {
+    blendPixelsScalar<Mode>(dst, src, count, opacity);
+}
+#endif
+
+// RGB565 layer pixels to premultiplied ARGB: rgb565Lut() with the transparent
+// key decoding to 0.
+const QRgb* rgb565Table() {
+    static const QVector<QRgb> table = [] {
+        QVector<QRgb> entries(65536);
+        std::copy(rgb565Lut(), rgb565Lut() + entries.size(), entries.begin());
+        entries[LayerStack::TransparentKey] = 0;
+        return entries;
+    }();
+    return table.constData();
+}
+
+void blendRow(QRgb* dst, const QRgb* src, int count, int opacity, BlendMode mode) {
+    switch (mode) {
+    case BlendMode::Multiply: blendRow<BlendMode::Multiply>(dst, src, count, opacity); break;
+    case BlendMode::Screen:   blendRow<BlendMode::Screen>(dst, src, count, opacity); break;
+    case BlendMode::Add:      blendRow<BlendMode::Add>(dst, src, count, opacity); break;
+    case BlendMode::Normal:   blendRow<BlendMode::Normal>(dst, src, count, opacity); break;
+    }
+}
+
+} // namespace
+
+LayerStack::LayerStack()
+    : stackWidth(0), stackHeight(0), tilesX(0), tilesY(0), current(0), hasDirty(false),
+      storageMode(PixelStorage::Argb32) {
+    setPalette(QVector<QRgb>());
+}
+
+void LayerStack::resize(int width, int height, PixelStorage storage) {
+    stackWidth = width;
+    stackHeight = height;
+    tilesX = (width + TileSize - 1) / TileSize;
+    tilesY = (height + TileSize - 1) / TileSize;
+    storageMode = storage;
+    setPalette(QVector<QRgb>());
+
+    Layer background;
+    background.name = "Background";
+    background.image = TiledImage(width, height, layerFormat(storage), encode(0xffffffffu));
+    background.image.setColorTable(indexPalette);
+    background.visible = true;
+    background.opacity = 255;
+    background.blendMode = BlendMode::Normal;
+
+    layerList.clear();
+    layerList.append(background);
+    current = 0;
+
+    compositeImage = TiledImage(width, height, storage == PixelStorage::Argb32 ? QImage::Format_RGB32 : QImage::Format_RGB16,
+                                storage == PixelStorage::Argb32 ? 0xffffffffu : 0xffffu);
+    dirtyRects = QVector<QRect>(tilesX * tilesY);
+    markAllDirty();
+}
+
+// Index 0 is always the transparent entry; an empty palette starts the
+// document with transparent and white.
+void LayerStack::setPalette(const QVector<QRgb>& palette) {
+    indexPalette = palette.isEmpty() ? QVector<QRgb>{0, 0xffffffffu} : palette.mid(0, MaxPaletteSize);
+    indexPalette[0] = 0;
+    paletteLookup.clear();
+    std::fill(paletteTable, paletteTable + MaxPaletteSize, 0u);
+    for (int i = 1; i < indexPalette.size(); ++i) {
+        paletteTable[i] = indexPalette[i] | 0xff000000u;
+        if (!paletteLookup.contains(paletteTable[i])) paletteLookup.insert(paletteTable[i], i);
+    }
+}
+
+void LayerStack::setCurrentIndex(int index) {
+    if (index >= 0 && index < layerList.size()) {
+        current = index;
+    }
+}
+
+int LayerStack::addLayer(const QString& name) {
+    Layer layer;
+    layer.name = name;
+    layer.image = TiledImage(stackWidth, stackHeight, layerFormat(storageMode), transparentValue(storageMode));
+    layer.image.setColorTable(indexPalette);
+    layer.visible = true;
+    layer.opacity = 255;
+    layer.blendMode = BlendMode::Normal;
+
+    current = layerList.isEmpty() ? 0 : current + 1;
+    layerList.insert(current, layer);
+    return current;
+}
+
+void LayerStack::removeLayer(int index) {
+    if (layerList.size() <= 1 || index < 0 || index >= layerList.size()) return;
+    bool wasVisible = layerList[index].visible;
+    layerList.remove(index);
+    current = qBound(0, current > index ? current - 1 : current, layerList.size() - 1);
+    if (wasVisible) markAllDirty();
+}
+
+void LayerStack::moveLayer(int from, int to) {
+    if (from == to || from < 0 || to < 0 || from >= layerList.size() || to >= layerList.size()) return;
+    layerList.move(from, to);
+    if (current == from) {
+        current = to;
+    } else if (from < current && to >= current) {
+        --current;
+    } else if (from > current && to <= current) {
+        ++current;
+    }
+    markAllDirty();
+}
+
+void LayerStack::setLayerName(int index, const QString& name) {
+    layerList[index].name = name;
+}
+
+void LayerStack::setLayerVisible(int index, bool visible) {
+    if (layerList[index].visible == visible) return;
+    layerList[index].visible = visible;
+    markAllDirty();
+}
+
+void LayerStack::setLayerOpacity(int index, int opacity) {
+    opacity = qBound(0, opacity, 255);
+    if (layerList[index].opacity == opacity) return;
+    layerList[index].opacity = opacity;
+    if (layerList[index].visible) markAllDirty();
+}
+
+void LayerStack::setLayerBlendMode(int index, BlendMode mode) {
+    if (layerList[index].blendMode == mode) return;
+    layerList[index].blendMode = mode;
+    if (layerList[index].visible) markAllDirty();
+}
+
+void LayerStack::setLayerImage(int index, const QImage& image) {
+    if (storageMode == PixelStorage::Argb32) {
+        layerList[index].image = TiledImage::fromImage(image, stackWidth, stackHeight, QImage::Format_ARGB32_Premultiplied);
+    } else {
+        // RGB565 images (mapped framebuffers) go into RGB565 layers as they
+        // are, apart from moving opaque pixels off the transparent key.
+        const bool packed = storageMode == PixelStorage::Rgb565 && image.format() == QImage::Format_RGB16;
+        const QImage source = packed ? image : image.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+        TiledImage target(stackWidth, stackHeight, layerFormat(storageMode), transparentValue(storageMode));
+        const int count = qMin(stackWidth, source.width());
+        QByteArray row(count * target.bytesPerPixel(), Qt::Uninitialized);
+        for (int y = 0; y < qMin(stackHeight, source.height()); ++y) {
+            if (packed) {
+                const quint16* line = reinterpret_cast<const quint16*>(source.constScanLine(y));
+                quint16* out = reinterpret_cast<quint16*>(row.data());
+                for (int x = 0; x < count; ++x) {
+                    out[x] = line[x] == TransparentKey ? quint16(TransparentKey ^ 0x0020) : line[x];
+                }
+            } else {
+                encodeRow(reinterpret_cast<const QRgb*>(source.constScanLine(y)), count, reinterpret_cast<uchar*>(row.data()));
+            }
+            target.writeLine(0, y, count, row.constData());
+        }
+        for (int t = 0; t < target.tileCount(); ++t) {
+            target.squeezeTile(t);
+        }
+        target.setColorTable(indexPalette);
+        layerList[index].image = target;
+    }
+    markAllDirty();
+}
+
+void LayerStack::setPixel(int x, int y, const QColor& color) {
+    layerList[current].image.setPixel(x, y, encode(color.rgba()));
+    syncPalette();
+    markDirty(QRect(x, y, 1, 1));
+}
+
+void LayerStack::erasePixel(int x, int y) {
+    layerList[current].image.setPixel(x, y, transparentValue(storageMode));
+    markDirty(QRect(x, y, 1, 1));
+}
+
+// Selection operations work on whole rows of the current layer so a block
+// move is a handful of memcpy calls rather than per-pixel writes. Blocks are
+// premultiplied ARGB whatever the storage.
+QImage LayerStack::copyRect(const QRect& rect) const {
+    const TiledImage& source = layerList[current].image;
+    if (storageMode == PixelStorage::Argb32) return source.copy(rect);
+
+    QRect bounded = rect & bounds();
+    if (bounded.isEmpty()) return QImage();
+    QImage block(bounded.size(), QImage::Format_ARGB32_Premultiplied);
+    QByteArray row(bounded.width() * source.bytesPerPixel(), Qt::Uninitialized);
+    for (int y = 0; y < bounded.height(); ++y) {
+        source.readLine(bounded.left(), bounded.top() + y, bounded.width(), row.data());
+        decodePixels(reinterpret_cast<const uchar*>(row.constData()), bounded.width(),
+                     reinterpret_cast<QRgb*>(block.scanLine(y)));
+    }
+    return block;
+}
+
+void LayerStack::fillRect(const QRect& rect, const QColor& color) {
+    QRect bounded = rect & bounds();
+    if (bounded.isEmpty()) return;
+
+    layerList[current].image.fill(bounded, encode(color.rgba()));
+    syncPalette();
+    markDirty(bounded);
+}
+
+// Brush strokes arrive as row spans, each written as a one-row fill.
+void LayerStack::fillSpans(const QVector<Span>& spans, const QColor& color) {
+    TiledImage& target = layerList[current].image;
+    const uint value = encode(color.rgba());
+    for (const Span& span : spans) {
+        const QRect row = QRect(span.x, span.y, span.length, 1) & bounds();
+        if (row.isEmpty()) continue;
+        target.fill(row, value);
+        markDirty(row);
+    }
+    syncPalette();
+}
+
+void LayerStack::clearRect(const QRect& rect) {
+    fillRect(rect, Qt::transparent);
+}
+
+void LayerStack::pasteImage(const QImage& image, const QPoint& topLeft) {
+    QImage block = image.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+    QRect bounded = QRect(topLeft, block.size()) & bounds();
+    if (bounded.isEmpty()) return;
+
+    TiledImage& target = layerList[current].image;
+    const QPoint offset = bounded.topLeft() - topLeft;
+    QByteArray row(bounded.width() * target.bytesPerPixel(), Qt::Uninitialized);
+    for (int y = 0; y < bounded.height(); ++y) {
+        const QRgb* line = reinterpret_cast<const QRgb*>(block.constScanLine(offset.y() + y)) + offset.x();
+        if (storageMode == PixelStorage::Argb32) {
+            target.writeLine(bounded.left(), bounded.top() + y, bounded.width(), line);
+        } else {
+            encodeRow(line, bounded.width(), reinterpret_cast<uchar*>(row.data()));
+            target.writeLine(bounded.left(), bounded.top() + y, bounded.width(), row.constData());
+        }
+    }
+    syncPalette();
+    markDirty(bounded);
+}
+
+// The storage follows the layers, so frames, snapshots and recovered
+// documents can be handed over as they are; indexed layers bring the palette
+// they were painted with.
+void LayerStack::setLayers(const QVector<Layer>& layers) {
+    layerList = layers;
+    current = qBound(0, current, layerList.size() - 1);
+    if (!layerList.isEmpty()) {
+        const PixelStorage storage = storageForFormat(layerList.first().image.format());
+        const QImage::Format format = storage == PixelStorage::Argb32 ? QImage::Format_RGB32 : QImage::Format_RGB16;
+        if (storage != storageMode || compositeImage.format() != format) {
+            storageMode = storage;
+            compositeImage = TiledImage(stackWidth, stackHeight, format, 0);
+        }
+        QVector<QRgb> palette = indexPalette;
+        for (const Layer& layer : layerList) {
+            if (layer.image.colorTable().size() > palette.size()) palette = layer.image.colorTable();
+        }
+        if (storageMode == PixelStorage::Indexed8 && palette.size() != indexPalette.size()) setPalette(palette);
+    }
+    markAllDirty();
+}
+
+void LayerStack::markDirty(const QRect& rect) {
+    QRect bounded = rect & QRect(0, 0, stackWidth, stackHeight);
+    if (bounded.isEmpty()) return;
+
+    for (int ty = bounded.top() / TileSize; ty <= bounded.bottom() / TileSize; ++ty) {
+        for (int tx = bounded.left() / TileSize; tx <= bounded.right() / TileSize; ++tx) {
+            QRect tileRect(tx * TileSize, ty * TileSize, TileSize, TileSize);
+            QRect& dirty = dirtyRects[ty * tilesX + tx];
+            dirty |= bounded & tileRect;
+        }
+    }
+    hasDirty = true;
+}
+
+void LayerStack::markAllDirty() {
+    markDirty(QRect(0, 0, stackWidth, stackHeight));
+}
+
+QVector<QRect> LayerStack::flush() {
+    QVector<QRect> refreshed;
+    if (!hasDirty) return refreshed;
+
+    for (int t = 0; t < dirtyRects.size(); ++t) {
+        QRect& dirty = dirtyRects[t];
+        if (dirty.isNull()) continue;
+        compositeTile(t, dirty);
+        refreshed.append(dirty);
+        dirty = QRect();
+    }
+    hasDirty = false;
+    return refreshed;
+}
+
+const TiledImage& LayerStack::composite() {
+    flush();
+    return compositeImage;
+}
+
+// Solid layer tiles are blended from their fill colour, so a tile nobody has
+// drawn on is one blend of a single pixel rather than a tile of pixels.
+// Compact layers are expanded a row at a time through their lookup table.
+void LayerStack::compositeTile(int index, const QRect& rect) {
+    const bool direct = compositeImage.format() == QImage::Format_RGB32;
+    bool solid = true;
+    for (const Layer& layer : layerList) {
+        if (layer.visible && layer.opacity > 0 && !layer.image.isSolid(index)) {
+            solid = false;
+            break;
+        }
+    }
+    if (solid) {
+        QRgb color = 0xffffffffu;
+        for (const Layer& layer : layerList) {
+            if (!layer.visible || layer.opacity == 0) continue;
+            const QRgb fill = decodeValue(layer.image.fillValue(index));
+            blendRow(&color, &fill, 1, layer.opacity, layer.blendMode);
+        }
+        compositeImage.setSolid(index, direct ? color : toRgb565(color));
+        return;
+    }
+
+    const QRect tile = compositeImage.tileRect(index);
+    const int offset = rect.left() - tile.left();
+    const int count = rect.width();
+    QRgb blended[TileSize];
+    QRgb source[TileSize];
+    for (int y = rect.top(); y <= rect.bottom(); ++y) {
+        const int row = y - tile.top();
+        QRgb* dst = direct ? reinterpret_cast<QRgb*>(compositeImage.scanLine(index, row)) + offset : blended;
+        std::fill(dst, dst + count, 0xffffffffu);
+        for (const Layer& layer : layerList) {
+            if (!layer.visible || layer.opacity == 0) continue;
+            const uchar* line = layer.image.constScanLine(index, row);
+            const QRgb* src = source;
+            if (!line) {
+                std::fill(source, source + count, decodeValue(layer.image.fillValue(index)));
+            } else if (storageMode == PixelStorage::Argb32) {
+                src = reinterpret_cast<const QRgb*>(line) + offset;
+            } else {
+                decodePixels(line + offset * layer.image.bytesPerPixel(), count, source);
+            }
+            blendRow(dst, src, count, layer.opacity, layer.blendMode);
+        }
+        if (!direct) {
+            quint16* out = reinterpret_cast<quint16*>(compositeImage.scanLine(index, row)) + offset;
+            for (int i = 0; i < count; ++i) {
+                out[i] = toRgb565(blended[i]);
+            }
+        }
+    }
+}
+
+// Layer values for an unpremultiplied colour. RGB565 layers are opaque, so
+// any visible colour that lands on the transparent key is nudged off it by
+// one step of green.
+uint LayerStack::encode(QRgb color) {
+    switch (storageMode) {
+    case PixelStorage::Rgb565: {
+        if (qAlpha(color) == 0) return TransparentKey;
+        const quint16 value = toRgb565(color);
+        return value == TransparentKey ? value ^ 0x0020 : value;
+    }
+    case PixelStorage::Indexed8:
+        return qAlpha(color) == 0 ? 0 : paletteIndex(color | 0xff000000u);
+    case PixelStorage::Argb32:
+        break;
+    }
+    return qPremultiply(color);
+}
+
+void LayerStack::encodeRow(const QRgb* premultiplied, int count, uchar* out) {
+    if (storageMode == PixelStorage::Rgb565) {
+        quint16* line = reinterpret_cast<quint16*>(out);
+        for (int i = 0; i < count; ++i) {
+            line[i] = quint16(encode(qUnpremultiply(premultiplied[i])));
+        }
+    } else {
+        for (int i = 0; i < count; ++i) {
+            out[i] = uchar(encode(qUnpremultiply(premultiplied[i])));
+        }
+    }
+}
+
+// New colours are appended while the palette has room; after that they map
+// to the nearest entry, remembered so each colour is only searched once.
+uint LayerStack::paletteIndex(QRgb color) {
+    auto it = paletteLookup.constFind(color);
+    if (it != paletteLookup.constEnd()) return it.value();
+
+    uint index = 1;
+    if (indexPalette.size() < MaxPaletteSize) {
+        index = indexPalette.size();
+        indexPalette.append(color);
+        paletteTable[index] = color;
+    } else {
+        int best = INT_MAX;
+        for (int i = 1; i < indexPalette.size(); ++i) {
+            const int dr = qRed(color) - qRed(indexPalette[i]);
+            const int dg = qGreen(color) - qGreen(indexPalette[i]);
+            const int db = qBlue(color) - qBlue(indexPalette[i]);
+            const int distance = dr * dr + dg * dg + db * db;
+            if (distance < best) {
+                best = distance;
+                index = i;
+            }
+        }
+    }
+    paletteLookup.insert(color, index);
+    return index;
+}
+
+// Indexed layers carry the palette they were painted with; it only grows,
+// so a layer whose table is as long as the document's is up to date.
+void LayerStack::syncPalette() {
+    if (storageMode != PixelStorage::Indexed8) return;
+    TiledImage& image = layerList[current].image;
+    if (image.colorTable().size() != indexPalette.size()) image.setColorTable(indexPalette);
+}
+
+QRgb LayerStack::decodeValue(uint value) const {
+    switch (storageMode) {
+    case PixelStorage::Rgb565:   return rgb565Table()[value & 0xFFFF];
+    case PixelStorage::Indexed8: return paletteTable[value & 0xFF];
+    case PixelStorage::Argb32:   break;
+    }
+    return value;
+}
+
+void LayerStack::decodePixels(const uchar* raw, int count, QRgb* out) const {
+    switch (storageMode) {
+    case PixelStorage::Rgb565: {
+        const QRgb* table = rgb565Table();
+        const quint16* values = reinterpret_cast<const quint16*>(raw);
+        for (int i = 0; i < count; ++i) {
+            out[i] = table[values[i]];
+        }
+        break;
+    }
+    case PixelStorage::Indexed8:
+        for (int i = 0; i < count; ++i) {
+            out[i] = paletteTable[raw[i]];
+        }
+        break;
+    case PixelStorage::Argb32:
+        memcpy(out, raw, count * sizeof(QRgb));
+        break;
+    }
+}
+
+QString LayerStack::blendModeName(BlendMode mode) {
+    switch (mode) {
+    case BlendMode::Multiply: return "Multiply";
+    case BlendMode::Screen:   return "Screen";
+    case BlendMode::Add:      return "Add";
+    case BlendMode::Normal:   break;
+    }
+    return "Normal";
+}
+
+QImage::Format LayerStack::layerFormat(PixelStorage storage) {
+    switch (storage) {
+    case PixelStorage::Rgb565:   return QImage::Format_RGB16;
+    case PixelStorage::Indexed8: return QImage::Format_Indexed8;
+    case PixelStorage::Argb32:   break;
+    }
+    return QImage::Format_ARGB32_Premultiplied;
+}
+
+uint LayerStack::transparentValue(PixelStorage storage) {
+    return storage == PixelStorage::Rgb565 ? TransparentKey : 0;
+}
+
+PixelStorage LayerStack::storageForFormat(QImage::Format format) {
+    switch (format) {
+    case QImage::Format_RGB16:    return PixelStorage::Rgb565;
+    case QImage::Format_Indexed8: return PixelStorage::Indexed8;
+    default:                      return PixelStorage::Argb32;
+    }
+}
+
+int LayerStack::tileCount(int width, int height) {
+    return TiledImage::tileCount(width, height);
+}
+
+QRect LayerStack::tileRect(int index, int width, int height) {
+    return TiledImage::tileRect(index, width, height);
+}
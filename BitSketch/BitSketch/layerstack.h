@@ -0,0 +1,125 @@
+#ifndef LAYERSTACK_H
+#define LAYERSTACK_H
+
+#include <QColor>
+#include <QHash>
+#include <QImage>
+#include <QRect>
+#include <QString>
+#include <QVector>
+#include "tiledimage.h"
+
+enum class BlendMode {
+    Normal,
+    Multiply,
+    Screen,
+    Add
+};
+
+// How layer pixels are stored, chosen per document. The compact modes keep
+// two or one bytes per pixel and composite to RGB565, which is exactly what
+// the hex export writes.
+enum class PixelStorage {
+    Argb32,  // premultiplied ARGB
+    Rgb565,  // opaque RGB565; LayerStack::TransparentKey is transparent
+    Indexed8 // indices into LayerStack::palette(); index 0 is transparent
+};
+
+struct Layer {
+    QString name;
+    TiledImage image; // LayerStack::layerFormat() of the document's storage
+    bool visible;
+    int opacity;  // 0..255
+    BlendMode blendMode;
+};
+
+// A run of cells on one row.
+struct Span {
+    int x;
+    int y;
+    int length;
+};
+
+// Ordered stack of layers (index 0 is the bottom) plus a flattened composite.
+// The composite is cached per tile; only tiles touched since the last flush()
+// are re-blended, and a tile where every visible layer is solid stays solid.
+class LayerStack {
+public:
+    static const int TileSize = TiledImage::TileSize;
+    static const quint16 TransparentKey = 0xF81F; // magenta, the usual RGB565 sprite key
+    static const int MaxPaletteSize = 256;
+
+    LayerStack();
+
+    void resize(int width, int height, PixelStorage storage = PixelStorage::Argb32);
+    int width() const { return stackWidth; }
+    int height() const { return stackHeight; }
+    QRect bounds() const { return QRect(0, 0, stackWidth, stackHeight); }
+    PixelStorage storage() const { return storageMode; }
+    QVector<QRgb> palette() const { return indexPalette; }
+    void setPalette(const QVector<QRgb>& palette);
+
+    int layerCount() const { return layerList.size(); }
+    const Layer& layer(int index) const { return layerList[index]; }
+    int currentIndex() const { return current; }
+    void setCurrentIndex(int index);
+
+    int addLayer(const QString& name);
+    void removeLayer(int index);
+    void moveLayer(int from, int to);
+    void setLayerName(int index, const QString& name);
+    void setLayerVisible(int index, bool visible);
+    void setLayerOpacity(int index, int opacity);
+    void setLayerBlendMode(int index, BlendMode mode);
+    void setLayerImage(int index, const QImage& image);
+
+    void setPixel(int x, int y, const QColor& color);
+    void erasePixel(int x, int y);
+
+    QImage copyRect(const QRect& rect) const;
+    void fillRect(const QRect& rect, const QColor& color);
+    void fillSpans(const QVector<Span>& spans, const QColor& color);
+    void clearRect(const QRect& rect);
+    void pasteImage(const QImage& image, const QPoint& topLeft);
+
+    QVector<Layer> layers() const { return layerList; }
+    void setLayers(const QVector<Layer>& layers);
+
+    void markDirty(const QRect& rect);
+    void markAllDirty();
+    QVector<QRect> flush();
+    const TiledImage& composite();
+    const TiledImage& cachedComposite() const { return compositeImage; } // as of the last flush()
+
+    static QString blendModeName(BlendMode mode);
+    static QImage::Format layerFormat(PixelStorage storage);
+    static uint transparentValue(PixelStorage storage);
+    static PixelStorage storageForFormat(QImage::Format format);
+    static int tileCount(int width, int height);
+    static QRect tileRect(int index, int width, int height);
+
+private:
+    void compositeTile(int index, const QRect& rect);
+    uint encode(QRgb color);
+    void encodeRow(const QRgb* premultiplied, int count, uchar* out);
+    uint paletteIndex(QRgb color);
+    void syncPalette();
+    QRgb decodeValue(uint value) const;
+    void decodePixels(const uchar* raw, int count, QRgb* out) const;
+
+    int stackWidth;
+    int stackHeight;
+    int tilesX;
+    int tilesY;
+    int current;
+    bool hasDirty;
+    PixelStorage storageMode;
+    QVector<QRgb> indexPalette;
+    QHash<QRgb, uint> paletteLookup;
+    QRgb paletteTable[MaxPaletteSize]; // indexPalette padded with transparent
+    QVector<Layer> layerList;
+    QVector<QRect> dirtyRects;
+    TiledImage compositeImage;
+};
+
+#endif // LAYERSTACK_H
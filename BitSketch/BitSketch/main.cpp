@@ -1,9 +1,24 @@
 #include "mainwindow.h"
+#include "commandline.h"
+#include "stallwatchdog.h"
+#include "trace.h"
 #include <QApplication>
 
 int main(int argc, char* argv[]) {
-    QApplication app(argc, argv);
-    MainWindow mainWin;
-    mainWin.show();
-    return app.exec();
+    Trace::startFromEnvironment(argc, argv);
+    int result;
+    if (wantsCommandLine(argc, argv)) {
+        QCoreApplication app(argc, argv);
+        result = runCommandLine(app);
+    } else {
+        QApplication app(argc, argv);
+        StallWatchdog watchdog;
+        watchdog.startWatching(StallWatchdog::thresholdFromEnvironment());
+        MainWindow mainWin;
+        mainWin.show();
+        result = app.exec();
+        watchdog.stopWatching();
+    }
+    Trace::finish();
+    return result;
 }
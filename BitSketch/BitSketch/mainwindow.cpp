@@ -1,18 +1,33 @@
 #include "mainwindow.h"
 #include "pixelartdialog.h"
+#include "autosavejournal.h"
+#include "hexexport.h"
+#include "tileset.h"
+#include "framedelta.h"
+#include "trace.h"
 #include <QFileDialog>
+#include <QFileInfo>
+#include <QImageReader>
 #include <QMessageBox>
+#include <QStatusBar>
 #include <QVBoxLayout>
-#include <QTextStream>
+#include <QHBoxLayout>
+#include <QTimer>
 
-MainWindow::MainWindow(QWidget* parent) : QMainWindow(parent), image(nullptr), pixelArtDialog(nullptr) {
+namespace {
+
+// Longest side of the preview shown for an opened image.
+const int ThumbnailSize = 512;
+
+} // namespace
+
+MainWindow::MainWindow(QWidget* parent) : QMainWindow(parent), pixelArtDialog(nullptr) {
     initUI();
     showMaximized();
+    QTimer::singleShot(0, this, &MainWindow::offerSessionRecovery);
 }
 
-MainWindow::~MainWindow() {
-    delete image;
-}
+MainWindow::~MainWindow() {}
 
 void MainWindow::initUI() {
     setWindowTitle("BitSketch");
@@ -27,67 +42,178 @@ void MainWindow::initUI() {
     saveButton = new QPushButton("Save HEX code", this);
     pixelEditorButton = new QPushButton("Edit pixel", this);
 
+    saveTilesetButton = new QPushButton("Save tileset + tilemap", this);
+    tileSizeInput = new QComboBox(this);
+    tileSizeInput->addItem("8x8 tiles", 8);
+    tileSizeInput->addItem("16x16 tiles", 16);
+    tileSizeInput->addItem("32x32 tiles", 32);
+    tileFlipCheckbox = new QCheckBox("Match flipped tiles", this);
+    saveDeltaButton = new QPushButton("Save changes since previous image", this);
+
+    QHBoxLayout* tilesetLayout = new QHBoxLayout;
+    tilesetLayout->addWidget(saveTilesetButton);
+    tilesetLayout->addWidget(tileSizeInput);
+    tilesetLayout->addWidget(tileFlipCheckbox);
+
     layout->addWidget(label);
     layout->addWidget(openButton);
     layout->addWidget(saveButton);
+    layout->addLayout(tilesetLayout);
+    layout->addWidget(saveDeltaButton);
     layout->addWidget(pixelEditorButton);
 
     connect(openButton, &QPushButton::clicked, this, &MainWindow::openImage);
     connect(saveButton, &QPushButton::clicked, this, &MainWindow::saveHex);
+    connect(saveTilesetButton, &QPushButton::clicked, this, &MainWindow::saveTileset);
+    connect(saveDeltaButton, &QPushButton::clicked, this, &MainWindow::saveDelta);
     connect(pixelEditorButton, &QPushButton::clicked, this, &MainWindow::openPixelEditor);
+    connect(&saveQueue, &SaveQueue::saved, this, &MainWindow::saveFinished);
+    connect(&saveQueue, &SaveQueue::failed, this, &MainWindow::saveFailed);
 }
 
+// Only a thumbnail is decoded here: QImageReader scales while decoding
+// where the codec can (JPEG decodes at 1/2, 1/4 or 1/8 size), so even very
+// large photos open quickly. The full image is decoded when it is converted.
 void MainWindow::openImage() {
     QString fileName = QFileDialog::getOpenFileName(this, "Select image", "", "Image Files (*.png *.jpg *.bmp)");
-    if (!fileName.isEmpty()) {
-        delete image;
-        image = new QPixmap(fileName);
-        label->setPixmap(*image);
-    }
-}
+    if (fileName.isEmpty()) return;
 
-void MainWindow::convertImageToHex() {
-    if (image) {
-        hexData.clear();
-        QImage img = image->toImage();
-        for (int y = 0; y < img.height(); ++y) {
-            QVector<QString> row;
-            for (int x = 0; x < img.width(); ++x) {
-                QColor color = img.pixelColor(x, y);
-                quint16 rgb565 = ((color.red() & 0xF8) << 8) | ((color.green() & 0xFC) << 3) | (color.blue() >> 3);
-                row.append(QString("0x%1").arg(rgb565, 4, 16, QChar('0')));
-            }
-            hexData.append(row);
-        }
-        QMessageBox::information(this, "Notification!", "Image has been converted to hex code.");
+    TRACE_SCOPE("MainWindow::openImage");
+    QImageReader reader(fileName);
+    const QSize size = reader.size();
+    if (size.isValid() && (size.width() > ThumbnailSize || size.height() > ThumbnailSize)) {
+        reader.setScaledSize(size.scaled(ThumbnailSize, ThumbnailSize, Qt::KeepAspectRatio));
+    }
+    const QImage thumbnail = reader.read();
+    if (thumbnail.isNull()) {
+        QMessageBox::warning(this, "Error!", QString("Can't open image: %1").arg(reader.errorString()));
+        return;
+    }
+    imagePath = fileName;
+    label->setPixmap(QPixmap::fromImage(thumbnail));
+    if (size.isValid()) {
+        statusBar()->showMessage(QString("%1: %2x%3").arg(QFileInfo(fileName).fileName()).arg(size.width()).arg(size.height()));
     }
 }
 
+// The image is decoded, converted and written on the save queue.
 void MainWindow::saveHex() {
-    convertImageToHex();
-    if (hexData.isEmpty()) {
+    if (imagePath.isEmpty()) {
         QMessageBox::warning(this, "Warning!", "No hex code data to save.");
         return;
     }
 
     QString savePath = QFileDialog::getSaveFileName(this, "Save hex code", "", "Hex Files (*.txt)");
-    if (!savePath.isEmpty()) {
+    if (savePath.isEmpty()) return;
+
+    const QString sourcePath = imagePath;
+    saveQueue.enqueue(savePath, QString("Saved hex code: %1").arg(savePath), [savePath, sourcePath](QString& error) {
+        TRACE_SCOPE("MainWindow::saveHex");
+        const QImage img(sourcePath);
+        if (img.isNull()) {
+            error = QString("Can't open %1").arg(sourcePath);
+            return false;
+        }
         QFile file(savePath);
-        if (file.open(QIODevice::WriteOnly | QIODevice::Text)) {
-            QTextStream out(&file);
-            out << "const uint16_t epd_bitmap_images [] PROGMEM = {\n";
-            for (const auto& row : hexData) {
-                QStringList rowList = QStringList(row.begin(), row.end());
-                out << rowList.join(", ") << ",\n";
-            }
-            out << "};\n";
-            file.close();
-            QMessageBox::information(this, "Notification!", QString("Saved hex code: %1").arg(savePath));
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+            error = file.errorString();
+            return false;
+        }
+        const bool written = writeHexArray(file, img, "epd_bitmap_images", false);
+        file.close();
+        if (!written || file.error() != QFileDevice::NoError) {
+            error = file.errorString();
+            return false;
+        }
+        return true;
+    });
+}
+
+void MainWindow::saveFinished(const QString& message) {
+    statusBar()->showMessage(message, 5000);
+}
+
+void MainWindow::saveFailed(const QString& path, const QString& error) {
+    statusBar()->showMessage(QString("Can't save %1: %2").arg(path, error));
+}
+
+// Decoding, tiling and writing happen on the save queue.
+void MainWindow::saveTileset() {
+    if (imagePath.isEmpty()) {
+        QMessageBox::warning(this, "Warning!", "No image to convert.");
+        return;
+    }
+
+    QString savePath = QFileDialog::getSaveFileName(this, "Save tileset", "", "Hex Files (*.txt *.h)");
+    if (savePath.isEmpty()) return;
+
+    const QString sourcePath = imagePath;
+    const int tileSize = tileSizeInput->currentData().toInt();
+    const bool flips = tileFlipCheckbox->isChecked();
+    saveQueue.enqueue(savePath, QString("Saved tileset: %1").arg(savePath),
+                      [savePath, sourcePath, tileSize, flips](QString& error) {
+        const QImage full(sourcePath);
+        if (full.isNull()) {
+            error = QString("Can't open %1").arg(sourcePath);
+            return false;
+        }
+        Tileset tileset;
+        if (!tileset.build(full, tileSize, flips) || !tileset.save(savePath)) {
+            error = tileset.errorString();
+            return false;
         }
+        return true;
+    });
+}
+
+// Exports only the rectangles of the loaded image that differ from an
+// earlier image already on the display. Both images are decoded and compared
+// on the save queue.
+void MainWindow::saveDelta() {
+    if (imagePath.isEmpty()) {
+        QMessageBox::warning(this, "Warning!", "No image to convert.");
+        return;
     }
+
+    QString previousPath = QFileDialog::getOpenFileName(this, "Select previous image", "", "Image Files (*.png *.jpg *.bmp)");
+    if (previousPath.isEmpty()) return;
+    QString savePath = QFileDialog::getSaveFileName(this, "Save changed rectangles", "", "Hex Files (*.txt *.h)");
+    if (savePath.isEmpty()) return;
+
+    const QString sourcePath = imagePath;
+    saveQueue.enqueue(savePath, QString("Saved changed rectangles: %1").arg(savePath),
+                      [savePath, sourcePath, previousPath](QString& error) {
+        const QImage previous(previousPath);
+        const QImage full(sourcePath);
+        if (previous.isNull() || full.isNull()) {
+            error = QString("Can't open %1").arg(previous.isNull() ? previousPath : sourcePath);
+            return false;
+        }
+        FrameDelta delta;
+        delta.setReference(previous);
+        if (!delta.addFrame(full) || !delta.save(savePath)) {
+            error = delta.errorString();
+            return false;
+        }
+        return true;
+    });
 }
 
 void MainWindow::openPixelEditor() {
     pixelArtDialog = new PixelArtDialog(this);
+    pixelArtDialog->setAttribute(Qt::WA_DeleteOnClose);
     pixelArtDialog->show();
 }
+
+void MainWindow::offerSessionRecovery() {
+    QString session = AutosaveJournal::findRecoverableSession();
+    if (session.isEmpty()) return;
+
+    if (QMessageBox::question(this, "Restore session",
+                              "BitSketch did not shut down cleanly. Restore the last pixel editor session?")
+        == QMessageBox::Yes) {
+        openPixelEditor();
+        pixelArtDialog->restoreSession(session);
+    }
+    AutosaveJournal::discardStaleSessions();
+}
@@ -4,8 +4,13 @@
 #include <QMainWindow>
 #include <QLabel>
 #include <QPushButton>
-#include <QPixmap>
+#include <QComboBox>
+#include <QCheckBox>
+#include <QImage>
+#include <QString>
+#include <QPointer>
 #include <QVector>
+#include "savequeue.h"
 
 class PixelArtDialog;
 
@@ -19,19 +24,27 @@ public:
 private slots:
     void openImage();
     void saveHex();
+    void saveTileset();
+    void saveDelta();
     void openPixelEditor();
+    void offerSessionRecovery();
+    void saveFinished(const QString& message);
+    void saveFailed(const QString& path, const QString& error);
 
 private:
     void initUI();
-    void convertImageToHex();
 
     QLabel* label;
     QPushButton* openButton;
     QPushButton* saveButton;
     QPushButton* pixelEditorButton;
-    QPixmap* image;
-    QVector<QVector<QString>> hexData;
-    PixelArtDialog* pixelArtDialog;
+    QPushButton* saveTilesetButton;
+    QPushButton* saveDeltaButton;
+    QComboBox* tileSizeInput;
+    QCheckBox* tileFlipCheckbox;
+    QString imagePath; // decoded in full only when converted
+    QPointer<PixelArtDialog> pixelArtDialog; // the newest editor, until it is closed
+    SaveQueue saveQueue;
 };
 
 #endif // MAINWINDOW_H
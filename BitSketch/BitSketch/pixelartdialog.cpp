@@ -1,23 +1,191 @@
 #include "pixelartdialog.h"
 #include "previewdialog.h"
+#include "rgb565.h"
+#include "framedelta.h"
+#include "trace.h"
+#include "canvasitem.h"
+#include "canvasview.h"
+#include "pngwriter.h"
+#include "hexarrayimport.h"
+#include "rawframebufferimport.h"
 #include <QGraphicsRectItem>
+#include <QGraphicsPixmapItem>
+#include <QApplication>
+#include <QClipboard>
 #include <QFileDialog>
+#include <QInputDialog>
 #include <QMessageBox>
 #include <QColorDialog>
 #include <QShortcut>
-#include <QPainter>
+#include <QtMath>
 #include <QMouseEvent>
-#include <QTextStream>
+#include <QFileInfo>
+#include <QSignalBlocker>
+#include <QSet>
 #include <QDebug>
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Clips spans to the canvas and merges overlapping or touching runs on the
+// same row, so stamps that overlap within one batch write each cell once.
+QVector<Span> mergeSpans(QVector<Span> spans, int width, int height) {
+    std::sort(spans.begin(), spans.end(), [](const Span& a, const Span& b) {
+        return a.y != b.y ? a.y < b.y : a.x < b.x;
+    });
+    QVector<Span> merged;
+    for (const Span& span : spans) {
+        const int left = qMax(0, span.x);
+        const int right = qMin(width, span.x + span.length);
+        if (span.y < 0 || span.y >= height || right <= left) continue;
+        if (!merged.isEmpty() && merged.last().y == span.y && left <= merged.last().x + merged.last().length) {
+            Span& last = merged.last();
+            last.length = qMax(last.length, right - last.x);
+        } else {
+            merged.append({left, span.y, right - left});
+        }
+    }
+    return merged;
+}
+
+// Shared tiles and equal fills are taken as equal without reading them; other
+// tiles are compared row by row.
+bool sameComposite(const TiledImage& a, const TiledImage& b) {
+    if (a.size() != b.size() || a.format() != b.format()) return false;
+    QByteArray rowA, rowB;
+    for (int t = 0; t < a.tileCount(); ++t) {
+        if (a.isSolid(t) && b.isSolid(t)) {
+            if (a.fillValue(t) != b.fillValue(t)) return false;
+            continue;
+        }
+        if (!a.isSolid(t) && !b.isSolid(t) && a.tile(t).cacheKey() == b.tile(t).cacheKey()) continue;
+        const QRect r = a.tileRect(t);
+        rowA.resize(r.width() * a.bytesPerPixel());
+        rowB.resize(rowA.size());
+        for (int y = r.top(); y <= r.bottom(); ++y) {
+            a.readLine(r.x(), y, r.width(), rowA.data());
+            b.readLine(r.x(), y, r.width(), rowB.data());
+            if (rowA != rowB) return false;
+        }
+    }
+    return true;
+}
+
+// Frame 0 is written whole, every later frame as the rectangles that differ
+// from the frame before it, for panels with partial refresh.
+bool writeAnimationDelta(const FrameStore& frames, const QString& path, QString& error) {
+    FrameDelta delta;
+    for (int f = 0; f < frames.frameCount(); ++f) {
+        delta.addFrame(frames.compositeFrame(f).toImage());
+    }
+    if (!delta.save(path)) {
+        error = delta.errorString();
+        return false;
+    }
+    return true;
+}
+
+// All frames go into one packed array; identical frames are emitted once and
+// share an entry in the offset table. Frames are composited one at a time: a
+// first pass finds the unique ones by hash, confirming a hit against the
+// earlier frame's tiles, and a second pass writes their rows.
+bool writeAnimationHex(const FrameStore& frames, const QString& path, QString& error) {
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+        error = file.errorString();
+        return false;
+    }
+
+    const int width = frames.width();
+    const int height = frames.height();
+    const qint64 framePixels = qint64(width) * height;
+    QVector<quint16> row(width);
+    QVector<QRgb> scratch;
+
+    QVector<int> uniqueFrames;
+    QMultiHash<uint, int> frameIndex;
+    QVector<qint64> offsets;
+    for (int f = 0; f < frames.frameCount(); ++f) {
+        const TiledImage composite = frames.compositeFrame(f);
+        uint hash = 0;
+        for (int y = 0; y < height; ++y) {
+            readRgb565Line(composite, y, row.data(), scratch);
+            hash = qHashBits(row.constData(), row.size() * sizeof(quint16), hash);
+        }
+
+        int match = -1;
+        for (auto it = frameIndex.constFind(hash); it != frameIndex.constEnd() && it.key() == hash; ++it) {
+            if (sameComposite(frames.compositeFrame(uniqueFrames[it.value()]), composite)) {
+                match = it.value();
+                break;
+            }
+        }
+        if (match < 0) {
+            match = uniqueFrames.size();
+            uniqueFrames.append(f);
+            frameIndex.insert(hash, match);
+        }
+        offsets.append(match * framePixels);
+    }
+    const bool wideOffsets = (uniqueFrames.size() - 1) * framePixels > 0xFFFFFFFFLL;
+
+    QByteArray text;
+    text += QString("// %1x%2, %3 frames, %4 unique\n").arg(width).arg(height).arg(offsets.size()).arg(uniqueFrames.size()).toLatin1();
+    text += QString("const uint16_t epd_bitmap_width = %1;\n").arg(width).toLatin1();
+    text += QString("const uint16_t epd_bitmap_height = %1;\n").arg(height).toLatin1();
+    text += QString("const uint16_t epd_bitmap_frame_count = %1;\n").arg(offsets.size()).toLatin1();
+    text += "const uint16_t epd_bitmap_images [] PROGMEM = {\n";
+    bool written = true;
+    for (int i = 0; i < uniqueFrames.size() && written; ++i) {
+        const TiledImage composite = frames.compositeFrame(uniqueFrames[i]);
+        for (int y = 0; y < height && written; ++y) {
+            readRgb565Line(composite, y, row.data(), scratch);
+            appendHexRow(text, row.constData(), row.size());
+            if (text.size() >= (1 << 20)) {
+                written = file.write(text) == text.size();
+                text.resize(0);
+            }
+        }
+    }
+    text += "};\n";
+    text += QString("const %1 epd_bitmap_frame_offsets [] PROGMEM = {\n").arg(wideOffsets ? "uint64_t" : "uint32_t").toLatin1();
+    QStringList offsetList;
+    for (qint64 offset : offsets) {
+        offsetList.append(QString::number(offset));
+    }
+    text += offsetList.join(", ").toLatin1() + ",\n};\n";
+    written = written && file.write(text) == text.size();
+    file.close();
+    if (!written || file.error() != QFileDevice::NoError) {
+        error = file.errorString();
+        return false;
+    }
+    return true;
+}
+
+} // namespace
 
 PixelArtDialog::PixelArtDialog(QWidget* parent)
-    : QDialog(parent), pixelSize(10), gridWidth(50), gridHeight(50), isDrawing(false), selectedColor(Qt::red) {
+    : QDialog(parent), pixelSize(10), gridWidth(50), gridHeight(50), isDrawing(false), selectedColor(Qt::red),
+      canvasItem(nullptr), pendingButtons(Qt::NoButton), isMovingSelection(false), selectionItem(nullptr), floatingItem(nullptr),
+      opacityEditLayer(-1), currentFrame(0), onionItem(nullptr), hudEnabled(false), lastPaintEnd(0),
+      hudWorstFrameNs(0) {
+    journal.startSession();
     initUI();
     showMaximized();
 }
 
 PixelArtDialog::~PixelArtDialog() {}
 
+// Closing (window button or Esc both end here) ends the autosave session: an
+// editor closed on purpose has nothing to recover.
+void PixelArtDialog::done(int result) {
+    autosaveTimer->stop();
+    journal.finishSession();
+    QDialog::done(result);
+}
+
 void PixelArtDialog::initUI() {
     setWindowTitle("Pixel Art Editor");
     setGeometry(100, 100, 500, 400);
@@ -26,13 +194,25 @@ void PixelArtDialog::initUI() {
     QShortcut* undoShortcut = new QShortcut(QKeySequence("Ctrl+Z"), this);
     connect(undoShortcut, &QShortcut::activated, this, &PixelArtDialog::undo);
 
+    QShortcut* saveShortcut = new QShortcut(QKeySequence::Save, this);
+    connect(saveShortcut, &QShortcut::activated, this, &PixelArtDialog::saveProject);
+
+    QShortcut* copyShortcut = new QShortcut(QKeySequence::Copy, this);
+    connect(copyShortcut, &QShortcut::activated, this, &PixelArtDialog::copySelection);
+
+    QShortcut* cutShortcut = new QShortcut(QKeySequence::Cut, this);
+    connect(cutShortcut, &QShortcut::activated, this, &PixelArtDialog::cutSelection);
+
+    QShortcut* pasteShortcut = new QShortcut(QKeySequence::Paste, this);
+    connect(pasteShortcut, &QShortcut::activated, this, &PixelArtDialog::pasteClipboard);
+
     widthInput = new QSpinBox(this);
-    widthInput->setRange(1, 1000);
+    widthInput->setRange(1, MaxCanvasSize);
     widthInput->setValue(gridWidth);
     widthInput->setPrefix("Width: ");
 
     heightInput = new QSpinBox(this);
-    heightInput->setRange(1, 1000);
+    heightInput->setRange(1, MaxCanvasSize);
     heightInput->setValue(gridHeight);
     heightInput->setPrefix("Height: ");
 
@@ -42,10 +222,21 @@ void PixelArtDialog::initUI() {
     openImageButton = new QPushButton("Open image...", this);
     connect(openImageButton, &QPushButton::clicked, this, &PixelArtDialog::openImage);
 
+    // Takes effect with the next "Apply dimensions" or opened image.
+    storageInput = new QComboBox(this);
+    storageInput->addItem("32-bit ARGB", int(PixelStorage::Argb32));
+    storageInput->addItem("RGB565 (2 bytes/pixel)", int(PixelStorage::Rgb565));
+    storageInput->addItem("8-bit indexed (1 byte/pixel)", int(PixelStorage::Indexed8));
+
+    // Compact documents already show exactly what the export writes.
+    targetPreviewCheckbox = new QCheckBox("Preview RGB565 output", this);
+    connect(targetPreviewCheckbox, &QCheckBox::toggled, this, &PixelArtDialog::toggleTargetPreview);
+
     scene = new QGraphicsScene(this);
     createPixelGrid();
 
-    view = new QGraphicsView(scene, this);
+    view = new CanvasView(scene, this);
+    connect(view, &CanvasView::painted, this, &PixelArtDialog::canvasPainted);
     view->setFixedSize(gridWidth * pixelSize + 1, gridHeight * pixelSize + 1);
 
     scrollArea = new QScrollArea(this);
@@ -70,15 +261,117 @@ void PixelArtDialog::initUI() {
     previewButton = new QPushButton("Preview", this);
     connect(previewButton, &QPushButton::clicked, this, &PixelArtDialog::previewImage);
 
+    pngLevelInput = new QComboBox(this);
+    pngLevelInput->addItem("PNG: uncompressed", 0);
+    pngLevelInput->addItem("PNG: fastest", 1);
+    pngLevelInput->addItem("PNG: balanced", PngWriter::DefaultLevel);
+    pngLevelInput->addItem("PNG: smallest", 9);
+    pngLevelInput->setCurrentIndex(pngLevelInput->findData(PngWriter::DefaultLevel));
+
+    parallelPngCheckbox = new QCheckBox("Multi-threaded PNG", this);
+    parallelPngCheckbox->setChecked(true);
+
+    selectToolButton = new QPushButton("Select", this);
+    selectToolButton->setCheckable(true);
+    connect(selectToolButton, &QPushButton::toggled, this, &PixelArtDialog::toggleSelectTool);
+
+    copyButton = new QPushButton("Copy", this);
+    connect(copyButton, &QPushButton::clicked, this, &PixelArtDialog::copySelection);
+
+    cutButton = new QPushButton("Cut", this);
+    connect(cutButton, &QPushButton::clicked, this, &PixelArtDialog::cutSelection);
+
+    pasteButton = new QPushButton("Paste", this);
+    connect(pasteButton, &QPushButton::clicked, this, &PixelArtDialog::pasteClipboard);
+
+    brushSizeInput = new QSpinBox(this);
+    brushSizeInput->setRange(1, MaxBrushSize);
+    brushSizeInput->setPrefix("Brush: ");
+    brushSizeInput->setSuffix(" px");
+    connect(brushSizeInput, QOverload<int>::of(&QSpinBox::valueChanged), this, &PixelArtDialog::updateBrush);
+
+    brushShapeInput = new QComboBox(this);
+    brushShapeInput->addItem("Square", SquareBrush);
+    brushShapeInput->addItem("Round", RoundBrush);
+    connect(brushShapeInput, QOverload<int>::of(&QComboBox::currentIndexChanged), this, &PixelArtDialog::updateBrush);
+
+    symmetryInput = new QComboBox(this);
+    symmetryInput->addItem("No symmetry", 0);
+    symmetryInput->addItem("Mirror left/right", int(MirrorX));
+    symmetryInput->addItem("Mirror top/bottom", int(MirrorY));
+    symmetryInput->addItem("4-way symmetry", int(MirrorX | MirrorY));
+    updateBrush();
+
     coordinateCheckbox = new QCheckBox("View coordinates", this);
     coordinateCheckbox->setChecked(false);
 
     coordinatesLabel = new QLabel(this);
     coordinatesLabel->setAlignment(Qt::AlignBottom | Qt::AlignLeft);
 
+    notificationLabel = new QLabel(this);
+    notificationTimer = new QTimer(this);
+    notificationTimer->setSingleShot(true);
+    notificationTimer->setInterval(5000);
+    connect(notificationTimer, &QTimer::timeout, notificationLabel, &QLabel::clear);
+    connect(&saveQueue, &SaveQueue::saved, this, &PixelArtDialog::saveFinished);
+    connect(&saveQueue, &SaveQueue::failed, this, &PixelArtDialog::saveFailed);
+    connect(&journal, &AutosaveJournal::checkpointFailed, this, &PixelArtDialog::saveFailed);
+
+    // Opaque, so refreshing the HUD never forces a repaint of the canvas below it.
+    hudLabel = new QLabel(scrollArea);
+    hudLabel->setStyleSheet("QLabel { background: #202020; color: #e0e0e0; font-family: monospace; padding: 4px; }");
+    hudLabel->setAttribute(Qt::WA_TransparentForMouseEvents);
+    hudLabel->move(8, 8);
+    hudLabel->hide();
+
+    hudCheckbox = new QCheckBox("Performance HUD (F3)", this);
+    connect(hudCheckbox, &QCheckBox::toggled, this, &PixelArtDialog::toggleHud);
+
+    QShortcut* hudShortcut = new QShortcut(QKeySequence(Qt::Key_F3), this);
+    connect(hudShortcut, &QShortcut::activated, hudCheckbox, &QCheckBox::toggle);
+
+    hudTimer = new QTimer(this);
+    connect(hudTimer, &QTimer::timeout, this, &PixelArtDialog::updateHud);
+
+    layerList = new QListWidget(this);
+    connect(layerList, &QListWidget::currentRowChanged, this, &PixelArtDialog::selectLayer);
+    connect(layerList, &QListWidget::itemChanged, this, &PixelArtDialog::layerItemChanged);
+
+    addLayerButton = new QPushButton("Add layer", this);
+    connect(addLayerButton, &QPushButton::clicked, this, &PixelArtDialog::addLayer);
+
+    removeLayerButton = new QPushButton("Remove layer", this);
+    connect(removeLayerButton, &QPushButton::clicked, this, &PixelArtDialog::removeLayer);
+
+    layerUpButton = new QPushButton("Move up", this);
+    connect(layerUpButton, &QPushButton::clicked, this, &PixelArtDialog::moveLayerUp);
+
+    layerDownButton = new QPushButton("Move down", this);
+    connect(layerDownButton, &QPushButton::clicked, this, &PixelArtDialog::moveLayerDown);
+
+    opacityInput = new QSpinBox(this);
+    opacityInput->setRange(0, 100);
+    opacityInput->setPrefix("Opacity: ");
+    opacityInput->setSuffix("%");
+    connect(opacityInput, QOverload<int>::of(&QSpinBox::valueChanged), this, &PixelArtDialog::changeLayerOpacity);
+    connect(opacityInput, &QSpinBox::editingFinished, this, &PixelArtDialog::finishOpacityEdit);
+
+    opacityEditTimer = new QTimer(this);
+    opacityEditTimer->setSingleShot(true);
+    opacityEditTimer->setInterval(OpacityEditMs);
+    connect(opacityEditTimer, &QTimer::timeout, this, &PixelArtDialog::finishOpacityEdit);
+
+    blendModeInput = new QComboBox(this);
+    for (BlendMode mode : {BlendMode::Normal, BlendMode::Multiply, BlendMode::Screen, BlendMode::Add}) {
+        blendModeInput->addItem(LayerStack::blendModeName(mode));
+    }
+    connect(blendModeInput, QOverload<int>::of(&QComboBox::currentIndexChanged), this, &PixelArtDialog::changeBlendMode);
+
     QHBoxLayout* buttonConfigLayout = new QHBoxLayout;
+    buttonConfigLayout->addWidget(storageInput);
     buttonConfigLayout->addWidget(applySizeButton);
     buttonConfigLayout->addWidget(openImageButton);
+    buttonConfigLayout->addWidget(targetPreviewCheckbox);
 
     QHBoxLayout* buttonLayout = new QHBoxLayout;
     buttonLayout->addWidget(colorButton);
@@ -87,52 +380,157 @@ void PixelArtDialog::initUI() {
     buttonLayout->addWidget(zoomInButton);
     buttonLayout->addWidget(zoomOutButton);
     buttonLayout->addWidget(previewButton);
+    buttonLayout->addWidget(pngLevelInput);
+    buttonLayout->addWidget(parallelPngCheckbox);
+
+    QHBoxLayout* brushLayout = new QHBoxLayout;
+    brushLayout->addWidget(brushSizeInput);
+    brushLayout->addWidget(brushShapeInput);
+    brushLayout->addWidget(symmetryInput);
+
+    QHBoxLayout* selectionLayout = new QHBoxLayout;
+    selectionLayout->addWidget(selectToolButton);
+    selectionLayout->addWidget(copyButton);
+    selectionLayout->addWidget(cutButton);
+    selectionLayout->addWidget(pasteButton);
+
+    frameList = new QListWidget(this);
+    frameList->setFlow(QListView::LeftToRight);
+    frameList->setIconSize(QSize(48, 48));
+    frameList->setFixedHeight(90);
+    connect(frameList, &QListWidget::currentRowChanged, this, &PixelArtDialog::selectFrame);
+
+    addFrameButton = new QPushButton("Add frame", this);
+    connect(addFrameButton, &QPushButton::clicked, this, &PixelArtDialog::addFrame);
+
+    removeFrameButton = new QPushButton("Delete frame", this);
+    connect(removeFrameButton, &QPushButton::clicked, this, &PixelArtDialog::removeFrame);
+
+    exportAnimationButton = new QPushButton("Export animation...", this);
+    connect(exportAnimationButton, &QPushButton::clicked, this, &PixelArtDialog::exportAnimation);
+
+    onionSkinCheckbox = new QCheckBox("Onion skin", this);
+    connect(onionSkinCheckbox, &QCheckBox::toggled, this, &PixelArtDialog::updateOnionSkin);
+
+    QHBoxLayout* frameButtonLayout = new QHBoxLayout;
+    frameButtonLayout->addWidget(addFrameButton);
+    frameButtonLayout->addWidget(removeFrameButton);
+    frameButtonLayout->addWidget(exportAnimationButton);
+    frameButtonLayout->addWidget(onionSkinCheckbox);
+
+    QHBoxLayout* layerButtonLayout = new QHBoxLayout;
+    layerButtonLayout->addWidget(addLayerButton);
+    layerButtonLayout->addWidget(removeLayerButton);
+
+    QHBoxLayout* layerOrderLayout = new QHBoxLayout;
+    layerOrderLayout->addWidget(layerUpButton);
+    layerOrderLayout->addWidget(layerDownButton);
+
+    QVBoxLayout* layerPanelLayout = new QVBoxLayout;
+    layerPanelLayout->addWidget(layerList);
+    layerPanelLayout->addWidget(opacityInput);
+    layerPanelLayout->addWidget(blendModeInput);
+    layerPanelLayout->addLayout(layerButtonLayout);
+    layerPanelLayout->addLayout(layerOrderLayout);
+
+    QHBoxLayout* canvasLayout = new QHBoxLayout;
+    canvasLayout->addWidget(scrollArea, 1);
+    canvasLayout->addLayout(layerPanelLayout);
 
     QVBoxLayout* layout = new QVBoxLayout(this);
     layout->addWidget(widthInput);
     layout->addWidget(heightInput);
     layout->addLayout(buttonConfigLayout);
-    layout->addWidget(scrollArea);
+    layout->addLayout(canvasLayout);
+    layout->addWidget(frameList);
+    layout->addLayout(frameButtonLayout);
     layout->addLayout(buttonLayout);
+    layout->addLayout(brushLayout);
+    layout->addLayout(selectionLayout);
     layout->addWidget(coordinateCheckbox);
+    layout->addWidget(hudCheckbox);
     layout->addWidget(coordinatesLabel);
+    layout->addWidget(notificationLabel);
     setLayout(layout);
 
+    refreshLayerPanel();
+    refreshFramePanel();
     view->viewport()->installEventFilter(this);
+
+    autosaveTimer = new QTimer(this);
+    connect(autosaveTimer, &QTimer::timeout, this, &PixelArtDialog::autosaveCheckpoint);
+    autosaveTimer->start(30000);
+
+    inputTimer = new QTimer(this);
+    inputTimer->setSingleShot(true);
+    inputTimer->setTimerType(Qt::PreciseTimer);
+    inputTimer->setInterval(InputFrameMs);
+    connect(inputTimer, &QTimer::timeout, this, &PixelArtDialog::inputFrameDue);
 }
 
 void PixelArtDialog::createPixelGrid() {
-    pixelMatrix.clear();
+    TRACE_SCOPE("PixelArtDialog::createPixelGrid");
     scene->clear();
-    for (int y = 0; y < gridHeight; ++y) {
-        QVector<QGraphicsRectItem*> row;
-        for (int x = 0; x < gridWidth; ++x) {
-            QGraphicsRectItem* rect = new QGraphicsRectItem(x * pixelSize, y * pixelSize, pixelSize, pixelSize);
-            rect->setBrush(QBrush(Qt::white));
-            rect->setPen(QPen(Qt::black));
-            rect->setFlag(QGraphicsItem::ItemIsSelectable);
-            scene->addItem(rect);
-            row.append(rect);
-        }
-        pixelMatrix.append(row);
-    }
+    selectionItem = nullptr;
+    floatingItem = nullptr;
+    onionItem = nullptr;
+    selection = QRect();
+    isMovingSelection = false;
+    history.clear();
+    layerStack.resize(gridWidth, gridHeight, static_cast<PixelStorage>(storageInput->currentData().toInt()));
+    canvasItem = new CanvasItem(&layerStack.composite(), pixelSize);
+    canvasItem->setTargetPreview(targetPreviewCheckbox->isChecked());
+    scene->addItem(canvasItem);
+    frameStore.reset(gridWidth, gridHeight, layerStack.layers());
+    currentFrame = 0;
+    refreshCanvas();
+    checkpointJournal();
 }
 void PixelArtDialog::applySize() {
+    TRACE_SCOPE("PixelArtDialog::applySize");
     gridWidth = widthInput->value();
     gridHeight = heightInput->value();
     view->setFixedSize(gridWidth * pixelSize + 2, gridHeight * pixelSize + 2);
     createPixelGrid();
+    refreshLayerPanel();
+    refreshFramePanel();
 }
 
 void PixelArtDialog::openImage() {
-    QString filePath = QFileDialog::getOpenFileName(this, "Select image", "", "Images (*.png *.xpm *.jpg *.bmp)");
+    QString filePath = QFileDialog::getOpenFileName(this, "Select image", "",
+                                                    "Images and projects (*.bsk *.png *.xpm *.jpg *.bmp);;"
+                                                    "RGB565 hex arrays (*.txt *.h *.c);;"
+                                                    "Raw framebuffers (*.bin *.raw);;All files (*)");
+    if (filePath.endsWith(".bsk")) {
+        openProject(filePath);
+        return;
+    }
     if (!filePath.isEmpty()) {
-        QImage image(filePath);
-        if (image.isNull()) {
-            QMessageBox::warning(this, "Error!", "Can't open image.");
+        const QString suffix = QFileInfo(filePath).suffix().toLower();
+        const bool raw = suffix == "bin" || suffix == "raw";
+        // Decoding is traced on its own so that the format and width prompts
+        // of raw dumps and hex arrays don't count as load time.
+        QImage image;
+        if (raw) {
+            image = importRawFramebuffer(filePath);
+        } else {
+            {
+                TRACE_SCOPE("PixelArtDialog::decodeImage");
+                image = QImage(filePath);
+            }
+            if (image.isNull()) image = importHexArray(filePath);
+        }
+        if (image.isNull()) return;
+        // The size inputs stop at MaxCanvasSize; anything larger would be cropped.
+        if (image.width() > MaxCanvasSize || image.height() > MaxCanvasSize) {
+            QMessageBox::warning(this, "Error!", QString("%1 is %2x%3 pixels; the editor opens images up to %4x%4.")
+                                     .arg(QFileInfo(filePath).fileName()).arg(image.width()).arg(image.height())
+                                     .arg(MaxCanvasSize));
             return;
         }
 
+        TRACE_SCOPE("PixelArtDialog::openImage");
+
         pixelSize = 1;
         gridWidth = image.width() / pixelSize;
         gridHeight = image.height() / pixelSize;
@@ -140,16 +538,48 @@ void PixelArtDialog::openImage() {
         heightInput->setValue(gridHeight);
         applySize();
 
-        for (int y = 0; y < qMin(gridHeight, image.height()); ++y) {
-            for (int x = 0; x < qMin(gridWidth, image.width()); ++x) {
-                QColor color = image.pixelColor(x * pixelSize, y * pixelSize);
-                pixelMatrix[y][x]->setBrush(QBrush(color));
-            }
-        }
+        layerStack.setLayerImage(0, image);
+        refreshCanvas();
+        storeCurrentFrame();
+        checkpointJournal();
         view->update();
     }
 }
 
+// Anything QImage can't decode is tried as an epd_bitmap style RGB565 array.
+QImage PixelArtDialog::importHexArray(const QString& filePath) {
+    HexArrayImport importer;
+    if (!importer.load(filePath) && importer.needsWidth()) {
+        bool ok;
+        const int width = QInputDialog::getInt(this, "Image width", importer.errorString(), 1, 1, 65535, 1, &ok);
+        if (!ok) return QImage();
+        importer.load(filePath, width);
+    }
+    if (importer.width() == 0) {
+        QMessageBox::warning(this, "Error!", "Can't open image: " + importer.errorString());
+        return QImage();
+    }
+    return importer.toImage();
+}
+
+// Both prompts are answered before RawFramebufferImport::load starts. The dump
+// is mapped rather than read; only the copy into the layer touches every pixel.
+QImage PixelArtDialog::importRawFramebuffer(const QString& filePath) {
+    bool ok;
+    const QStringList formats = {"RGB565", "RGB888", "ARGB32"};
+    const QString format = QInputDialog::getItem(this, "Raw framebuffer", "Pixel format:", formats, 0, false, &ok);
+    if (!ok) return QImage();
+    const int width = QInputDialog::getInt(this, "Raw framebuffer", "Width:", gridWidth, 1, 65535, 1, &ok);
+    if (!ok) return QImage();
+
+    RawFramebufferImport importer;
+    if (!importer.load(filePath, width, PixelFormat(formats.indexOf(format)))) {
+        QMessageBox::warning(this, "Error!", "Can't open framebuffer: " + importer.errorString());
+        return QImage();
+    }
+    return importer.image();
+}
+
 void PixelArtDialog::chooseColor() {
     QColor color = QColorDialog::getColor();
     if (color.isValid()) {
@@ -158,6 +588,31 @@ void PixelArtDialog::chooseColor() {
 }
 
 bool PixelArtDialog::eventFilter(QObject* obj, QEvent* event) {
+    if (!hudEnabled || obj != view->viewport() || event->type() == QEvent::Paint) {
+        return filterCanvasEvent(obj, event);
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    const bool handled = filterCanvasEvent(obj, event);
+    hudCurrent.filterNs += timer.nsecsElapsed();
+    return handled;
+}
+
+// A repaint of the view closes the HUD frame.
+void PixelArtDialog::canvasPainted(qint64 paintNs) {
+    if (!hudEnabled) return;
+    hudCurrent.paintNs = paintNs;
+
+    const qint64 now = hudClock.nsecsElapsed();
+    hudCurrent.frameNs = now - lastPaintEnd;
+    lastPaintEnd = now;
+    hudWorstFrameNs = qMax(hudWorstFrameNs, hudCurrent.frameNs);
+    hudLast = hudCurrent;
+    hudCurrent = HudFrame();
+}
+
+bool PixelArtDialog::filterCanvasEvent(QObject* obj, QEvent* event) {
     if (obj == view->viewport()) {
         if (event->type() == QEvent::Wheel) {
             QWheelEvent* wheelEvent = static_cast<QWheelEvent*>(event);
@@ -169,43 +624,46 @@ bool PixelArtDialog::eventFilter(QObject* obj, QEvent* event) {
         } else if (event->type() == QEvent::MouseButtonPress) {
             QMouseEvent* mouseEvent = static_cast<QMouseEvent*>(event);
             QPointF pos = view->mapToScene(mouseEvent->pos());
-            saveStateToHistory();
             isDrawing = true;
+            if (selectToolButton->isChecked()) {
+                if (mouseEvent->button() == Qt::LeftButton) {
+                    selectionPress(cellFromScene(pos));
+                }
+                return true;
+            }
+            saveStateToHistory();
 
-            for (int y = 0; y < gridHeight; ++y) {
-                for (int x = 0; x < gridWidth; ++x) {
-                    if (pixelMatrix[y][x]->contains(pos)) {
-                        if (mouseEvent->button() == Qt::LeftButton && !coordinateCheckbox->isChecked()) {
-                            pixelMatrix[y][x]->setBrush(QBrush(selectedColor));
-                        } else if (mouseEvent->button() == Qt::RightButton) {
-                            pixelMatrix[y][x]->setBrush(QBrush(Qt::white));
-                        }
-                        if (coordinateCheckbox->isChecked()) {
-                            coordinatesLabel->setText(QString("Coordinates: (%1, %2)").arg(x).arg(y));
-                        }
-                    }
+            int x, y;
+            lastStrokeCell = cellFromScene(pos);
+            if (cellAt(pos, x, y)) {
+                QVector<Span> spans;
+                stampBrush(lastStrokeCell, spans);
+                if (mouseEvent->button() == Qt::LeftButton && !coordinateCheckbox->isChecked()) {
+                    paintSpans(spans, selectedColor);
+                } else if (mouseEvent->button() == Qt::RightButton) {
+                    paintSpans(spans, Qt::transparent);
                 }
+                if (coordinateCheckbox->isChecked()) showCoordinates(x, y);
+                refreshCanvas();
             }
             return true;
         } else if (event->type() == QEvent::MouseMove && isDrawing) {
+            // Moves only queue their cell; a change of buttons applies what
+            // was queued under the old ones first.
             QMouseEvent* mouseEvent = static_cast<QMouseEvent*>(event);
-            QPointF pos = view->mapToScene(mouseEvent->pos());
-            for (int y = 0; y < gridHeight; ++y) {
-                for (int x = 0; x < gridWidth; ++x) {
-                    if (pixelMatrix[y][x]->contains(pos)) {
-                        if (mouseEvent->buttons() & Qt::LeftButton && !coordinateCheckbox->isChecked()) {
-                            pixelMatrix[y][x]->setBrush(QBrush(selectedColor));
-                        } else if (mouseEvent->buttons() & Qt::RightButton) {
-                            pixelMatrix[y][x]->setBrush(QBrush(Qt::white));
-                        }
-                        if (coordinateCheckbox->isChecked()) {
-                            coordinatesLabel->setText(QString("Coordinates: (%1, %2)").arg(x).arg(y));
-                        }
-                    }
-                }
-            }
+            if (!pendingCells.isEmpty() && mouseEvent->buttons() != pendingButtons) flushInput();
+            pendingButtons = mouseEvent->buttons();
+            pendingCells.append(cellFromScene(view->mapToScene(mouseEvent->pos())));
+            if (!inputTimer->isActive()) inputTimer->start();
             return true;
         } else if (event->type() == QEvent::MouseButtonRelease) {
+            QMouseEvent* mouseEvent = static_cast<QMouseEvent*>(event);
+            flushInput();
+            if (isDrawing && selectToolButton->isChecked() && mouseEvent->button() == Qt::LeftButton) {
+                selectionRelease(cellFromScene(view->mapToScene(mouseEvent->pos())));
+            }
+            journal.recordSpans(layerStack.currentIndex(), strokeWrites);
+            strokeWrites.clear();
             isDrawing = false;
             return true;
         }
@@ -213,25 +671,362 @@ bool PixelArtDialog::eventFilter(QObject* obj, QEvent* event) {
     return QDialog::eventFilter(obj, event);
 }
 
-void PixelArtDialog::saveStateToHistory() {
-    QVector<QColor> state;
-    for (int y = 0; y < gridHeight; ++y) {
-        for (int x = 0; x < gridWidth; ++x) {
-            state.append(pixelMatrix[y][x]->brush().color());
+// The stamp only changes with the brush settings: one span per row, offset
+// from the cell under the cursor. Round brushes keep pixel centres slightly
+// inside half the size so small ones do not come out square.
+void PixelArtDialog::updateBrush() {
+    const int size = brushSizeInput->value();
+    const bool round = brushShapeInput->currentData().toInt() == RoundBrush;
+    const int origin = (size - 1) / 2;
+    const double centre = (size - 1) / 2.0;
+    const double radius = size / 2.0 - 0.25;
+    brushStamp.clear();
+    for (int row = 0; row < size; ++row) {
+        int left = 0;
+        int right = size - 1;
+        if (round) {
+            const double dy = row - centre;
+            const double half = std::sqrt(qMax(0.0, radius * radius - dy * dy));
+            left = qCeil(centre - half);
+            right = qFloor(centre + half);
+        }
+        if (right >= left) brushStamp.append({left - origin, row - origin, right - left + 1});
+    }
+}
+
+// Appends the brush stamp at cell and its mirror images across the canvas
+// centre lines.
+void PixelArtDialog::stampBrush(const QPoint& cell, QVector<Span>& spans) const {
+    const int symmetry = symmetryInput->currentData().toInt();
+    for (const Span& row : brushStamp) {
+        const Span span{cell.x() + row.x, cell.y() + row.y, row.length};
+        const int mirroredX = gridWidth - span.x - span.length;
+        const int mirroredY = gridHeight - 1 - span.y;
+        spans.append(span);
+        if (symmetry & MirrorX) spans.append({mirroredX, span.y, span.length});
+        if (symmetry & MirrorY) spans.append({span.x, mirroredY, span.length});
+        if ((symmetry & MirrorX) && (symmetry & MirrorY)) spans.append({mirroredX, mirroredY, span.length});
+    }
+}
+
+// Stamps every cell on the line after from up to to, so a fast drag leaves
+// no gaps between the positions reported within one frame.
+void PixelArtDialog::strokeTo(const QPoint& from, const QPoint& to, QVector<Span>& spans) const {
+    const int dx = qAbs(to.x() - from.x());
+    const int dy = -qAbs(to.y() - from.y());
+    const int stepX = from.x() < to.x() ? 1 : -1;
+    const int stepY = from.y() < to.y() ? 1 : -1;
+    int error = dx + dy;
+    QPoint cell = from;
+    while (cell != to) {
+        const int twice = 2 * error;
+        if (twice >= dy) {
+            error += dy;
+            cell.rx() += stepX;
+        }
+        if (twice <= dx) {
+            error += dx;
+            cell.ry() += stepY;
+        }
+        stampBrush(cell, spans);
+    }
+}
+
+void PixelArtDialog::paintSpans(const QVector<Span>& spans, const QColor& color) {
+    const QVector<Span> merged = mergeSpans(spans, gridWidth, gridHeight);
+    layerStack.fillSpans(merged, color);
+    for (const Span& span : merged) {
+        strokeWrites.append({span.x, span.y, span.length, color.rgba()});
+    }
+}
+
+// The label only changes once per frame and only when the text does, so a
+// drag does not relayout the dialog for every mouse move.
+void PixelArtDialog::showCoordinates(int x, int y) {
+    const QString text = QString("Coordinates: (%1, %2)").arg(x).arg(y);
+    if (coordinatesLabel->text() != text) coordinatesLabel->setText(text);
+}
+
+// Applies the moves queued since the last frame as one batch: the stroke is
+// rasterized through every queued position into row spans, which are merged
+// and written together before the canvas and label are refreshed once.
+void PixelArtDialog::flushInput() {
+    inputTimer->stop();
+    if (pendingCells.isEmpty()) return;
+    const QPoint last = pendingCells.last();
+
+    if (selectToolButton->isChecked()) {
+        if (pendingButtons & Qt::LeftButton) selectionDrag(last);
+        pendingCells.clear();
+        return;
+    }
+
+    const bool paint = (pendingButtons & Qt::LeftButton) && !coordinateCheckbox->isChecked();
+    const bool erase = !paint && (pendingButtons & Qt::RightButton);
+    if (paint || erase) {
+        QVector<Span> spans;
+        for (const QPoint& cell : pendingCells) {
+            strokeTo(lastStrokeCell, cell, spans);
+            lastStrokeCell = cell;
         }
+        paintSpans(spans, paint ? selectedColor : QColor(Qt::transparent));
+    }
+    lastStrokeCell = last;
+    pendingCells.clear();
+
+    if (coordinateCheckbox->isChecked() && last.x() >= 0 && last.y() >= 0 && last.x() < gridWidth
+        && last.y() < gridHeight) {
+        showCoordinates(last.x(), last.y());
     }
-    history.append(state);
+    refreshCanvas();
+}
+
+// Batches flushed by the frame timer run outside eventFilter, so the HUD
+// times them here; flushes from inside the filter are already counted.
+void PixelArtDialog::inputFrameDue() {
+    if (!hudEnabled) {
+        flushInput();
+        return;
+    }
+    QElapsedTimer timer;
+    timer.start();
+    flushInput();
+    hudCurrent.filterNs += timer.nsecsElapsed();
+}
+
+QPoint PixelArtDialog::cellFromScene(const QPointF& pos) const {
+    return QPoint(qFloor(pos.x() / pixelSize), qFloor(pos.y() / pixelSize));
+}
+
+bool PixelArtDialog::cellAt(const QPointF& pos, int& x, int& y) const {
+    QPoint cell = cellFromScene(pos);
+    x = cell.x();
+    y = cell.y();
+    return x >= 0 && y >= 0 && x < gridWidth && y < gridHeight;
+}
+
+void PixelArtDialog::setSelection(const QRect& rect) {
+    selection = rect & layerStack.bounds();
+    if (selection.isEmpty()) {
+        if (selectionItem) selectionItem->hide();
+        return;
+    }
+    if (!selectionItem) {
+        selectionItem = scene->addRect(QRectF(), QPen(Qt::blue, 0, Qt::DashLine));
+        selectionItem->setZValue(2);
+    }
+    selectionItem->setRect(selection.left() * pixelSize, selection.top() * pixelSize,
+                           selection.width() * pixelSize, selection.height() * pixelSize);
+    selectionItem->show();
+}
+
+// Dragging inside the selection lifts its pixels into a floating pixmap that
+// follows the cursor; they are blitted back into the layer on release, so the
+// whole move is a single history entry.
+void PixelArtDialog::selectionPress(const QPoint& cell) {
+    if (selection.contains(cell)) {
+        saveStateToHistory();
+        floatingImage = layerStack.copyRect(selection);
+        layerStack.clearRect(selection);
+        journal.recordFill(layerStack.currentIndex(), selection, 0);
+        refreshCanvas();
+
+        floatingItem = scene->addPixmap(QPixmap::fromImage(floatingImage));
+        floatingItem->setScale(pixelSize);
+        floatingItem->setPos(selection.left() * pixelSize, selection.top() * pixelSize);
+        floatingItem->setZValue(1);
+        moveOrigin = cell;
+        isMovingSelection = true;
+    } else {
+        selectionAnchor = cell;
+        setSelection(QRect(cell, cell));
+    }
+}
+
+void PixelArtDialog::selectionDrag(const QPoint& cell) {
+    if (isMovingSelection) {
+        QPoint topLeft = selection.topLeft() + cell - moveOrigin;
+        floatingItem->setPos(topLeft.x() * pixelSize, topLeft.y() * pixelSize);
+        selectionItem->setRect(topLeft.x() * pixelSize, topLeft.y() * pixelSize,
+                               selection.width() * pixelSize, selection.height() * pixelSize);
+    } else {
+        setSelection(QRect(selectionAnchor, cell).normalized());
+    }
+}
+
+void PixelArtDialog::selectionRelease(const QPoint& cell) {
+    if (!isMovingSelection) return;
+
+    QRect moved = selection.translated(cell - moveOrigin);
+    layerStack.pasteImage(floatingImage, moved.topLeft());
+    journal.recordBlock(layerStack.currentIndex(), moved.topLeft(), floatingImage);
+    delete floatingItem;
+    floatingItem = nullptr;
+    floatingImage = QImage();
+    isMovingSelection = false;
+    setSelection(moved);
+    refreshCanvas();
+}
+
+void PixelArtDialog::toggleSelectTool(bool checked) {
+    if (!checked) setSelection(QRect());
+}
+
+void PixelArtDialog::copySelection() {
+    if (selection.isEmpty()) return;
+    clipboardImage = layerStack.copyRect(selection);
+    QApplication::clipboard()->setImage(clipboardImage.convertToFormat(QImage::Format_ARGB32));
+}
+
+void PixelArtDialog::cutSelection() {
+    if (selection.isEmpty()) return;
+    copySelection();
+    saveStateToHistory();
+    layerStack.clearRect(selection);
+    journal.recordFill(layerStack.currentIndex(), selection, 0);
+    refreshCanvas();
+}
+
+void PixelArtDialog::pasteClipboard() {
+    QImage image = QApplication::clipboard()->image();
+    if (image.isNull()) image = clipboardImage;
+    if (image.isNull()) return;
+
+    QPoint topLeft = selection.isEmpty() ? QPoint(0, 0) : selection.topLeft();
+    saveStateToHistory();
+    layerStack.pasteImage(image, topLeft);
+    journal.recordBlock(layerStack.currentIndex(), topLeft, image);
+    refreshCanvas();
+    selectToolButton->setChecked(true);
+    setSelection(QRect(topLeft, image.size()));
+}
+
+void PixelArtDialog::refreshCanvas() {
+    const QVector<QRect> refreshed = layerStack.flush();
+    for (const QRect& rect : refreshed) {
+        if (hudEnabled) hudCurrent.dirtyCells += rect.width() * rect.height();
+        canvasItem->updateCells(rect);
+    }
+}
+
+// Layers are listed top-most first.
+int PixelArtDialog::layerIndexForRow(int row) const {
+    return layerStack.layerCount() - 1 - row;
+}
+
+void PixelArtDialog::refreshLayerPanel() {
+    QSignalBlocker blocker(layerList);
+    layerList->clear();
+    for (int i = layerStack.layerCount() - 1; i >= 0; --i) {
+        const Layer& layer = layerStack.layer(i);
+        QListWidgetItem* item = new QListWidgetItem(layer.name, layerList);
+        item->setFlags(item->flags() | Qt::ItemIsUserCheckable | Qt::ItemIsEditable);
+        item->setCheckState(layer.visible ? Qt::Checked : Qt::Unchecked);
+    }
+    layerList->setCurrentRow(layerIndexForRow(layerStack.currentIndex()));
+    removeLayerButton->setEnabled(layerStack.layerCount() > 1);
+    updateLayerControls();
+}
+
+void PixelArtDialog::updateLayerControls() {
+    QSignalBlocker opacityBlocker(opacityInput);
+    QSignalBlocker blendBlocker(blendModeInput);
+    const Layer& layer = layerStack.layer(layerStack.currentIndex());
+    opacityInput->setValue(qRound(layer.opacity * 100 / 255.0));
+    blendModeInput->setCurrentIndex(static_cast<int>(layer.blendMode));
+}
+
+void PixelArtDialog::addLayer() {
+    saveStateToHistory();
+    layerStack.addLayer(QString("Layer %1").arg(layerStack.layerCount()));
+    refreshLayerPanel();
+    checkpointJournal();
+}
+
+void PixelArtDialog::removeLayer() {
+    if (layerStack.layerCount() <= 1) return;
+    saveStateToHistory();
+    layerStack.removeLayer(layerStack.currentIndex());
+    refreshCanvas();
+    refreshLayerPanel();
+    checkpointJournal();
+}
+
+void PixelArtDialog::moveLayerUp() {
+    int index = layerStack.currentIndex();
+    if (index + 1 >= layerStack.layerCount()) return;
+    saveStateToHistory();
+    layerStack.moveLayer(index, index + 1);
+    refreshCanvas();
+    refreshLayerPanel();
+    checkpointJournal();
+}
+
+void PixelArtDialog::moveLayerDown() {
+    int index = layerStack.currentIndex();
+    if (index == 0) return;
+    saveStateToHistory();
+    layerStack.moveLayer(index, index - 1);
+    refreshCanvas();
+    refreshLayerPanel();
+    checkpointJournal();
+}
+
+void PixelArtDialog::selectLayer(int row) {
+    if (row < 0) return;
+    layerStack.setCurrentIndex(layerIndexForRow(row));
+    updateLayerControls();
+}
+
+void PixelArtDialog::layerItemChanged(QListWidgetItem* item) {
+    int index = layerIndexForRow(layerList->row(item));
+    layerStack.setLayerName(index, item->text());
+    layerStack.setLayerVisible(index, item->checkState() == Qt::Checked);
+    refreshCanvas();
+    checkpointJournal();
+}
+
+// A spinbox drag is one history entry, taken before its first step; the
+// journal is checkpointed once the edit is finished.
+void PixelArtDialog::changeLayerOpacity(int percent) {
+    if (opacityEditLayer != layerStack.currentIndex()) {
+        saveStateToHistory();
+        opacityEditLayer = layerStack.currentIndex();
+    }
+    layerStack.setLayerOpacity(layerStack.currentIndex(), qRound(percent * 255 / 100.0));
+    refreshCanvas();
+    opacityEditTimer->start();
+}
+
+void PixelArtDialog::finishOpacityEdit() {
+    if (opacityEditLayer < 0) return;
+    opacityEditLayer = -1;
+    opacityEditTimer->stop();
+    checkpointJournal();
+}
+
+void PixelArtDialog::changeBlendMode(int modeIndex) {
+    saveStateToHistory();
+    layerStack.setLayerBlendMode(layerStack.currentIndex(), static_cast<BlendMode>(modeIndex));
+    refreshCanvas();
+    checkpointJournal();
+}
+
+// Any other edit ends a pending opacity edit, so the two undo separately.
+void PixelArtDialog::saveStateToHistory() {
+    TRACE_SCOPE("PixelArtDialog::saveStateToHistory");
+    finishOpacityEdit();
+    history.append(layerStack.layers());
 }
 
 void PixelArtDialog::undo() {
+    TRACE_SCOPE("PixelArtDialog::undo");
+    finishOpacityEdit();
     if (!history.isEmpty()) {
-        QVector<QColor> lastState = history.takeLast();
-        int index = 0;
-        for (int y = 0; y < gridHeight; ++y) {
-            for (int x = 0; x < gridWidth; ++x) {
-                pixelMatrix[y][x]->setBrush(QBrush(lastState[index++]));
-            }
-        }
+        layerStack.setLayers(history.takeLast());
+        refreshCanvas();
+        refreshLayerPanel();
+        checkpointJournal();
         view->update();
     }
 }
@@ -249,19 +1044,16 @@ void PixelArtDialog::zoomOut() {
 }
 
 void PixelArtDialog::updatePixelSizes() {
-    for (int y = 0; y < gridHeight; ++y) {
-        for (int x = 0; x < gridWidth; ++x) {
-            QGraphicsRectItem* rect = pixelMatrix[y][x];
-            rect->setRect(x * pixelSize, y * pixelSize, pixelSize, pixelSize);
-        }
-    }
+    canvasItem->setCellSize(pixelSize);
     view->setFixedSize(gridWidth * pixelSize + 1, gridHeight * pixelSize + 1);
+    setSelection(selection);
+    if (onionItem) onionItem->setScale(pixelSize);
 }
 
 void PixelArtDialog::savePixelDesign() {
     QFileDialog dialog(this);
     dialog.setWindowTitle("Save pixel design");
-    dialog.setNameFilter("PNG Files (*.png);;Hex Files (*.txt)");
+    dialog.setNameFilter("PNG Files (*.png);;Hex Files (*.txt);;BitSketch Project (*.bsk)");
     dialog.setDefaultSuffix("png");
     dialog.setAcceptMode(QFileDialog::AcceptSave);
 
@@ -273,56 +1065,355 @@ void PixelArtDialog::savePixelDesign() {
                 saveAsImage(savePath);
             } else if (savePath.endsWith(".txt")) {
                 saveAsHex(savePath);
+            } else if (savePath.endsWith(".bsk")) {
+                saveAsProject(savePath);
             }
         } else {
             qDebug() << "No file selected!";
         }
     }
 }
-void PixelArtDialog::saveAsImage(const QString& path) {
-    QImage image(gridWidth, gridHeight, QImage::Format_RGB32);
-    QPainter painter(&image);
-    for (int y = 0; y < gridHeight; ++y) {
-        for (int x = 0; x < gridWidth; ++x) {
-            QColor color = pixelMatrix[y][x]->brush().color();
-            painter.fillRect(x, y, pixelSize, pixelSize, color);
-        }
+void PixelArtDialog::saveProject() {
+    if (projectPath.isEmpty()) {
+        savePixelDesign();
+    } else {
+        saveAsProject(projectPath);
     }
-    painter.end();
-    image.save(path);
-    QMessageBox::information(this, "Notification", QString("Design saved as image: %1").arg(path));
 }
 
-void PixelArtDialog::saveAsHex(const QString& path) {
-    QFile file(path);
-    if (file.open(QIODevice::WriteOnly | QIODevice::Text)) {
-        QTextStream out(&file);
-        for (int y = 0; y < gridHeight; ++y) {
-            QStringList row;
-            for (int x = 0; x < gridWidth; ++x) {
-                QColor color = pixelMatrix[y][x]->brush().color();
-                quint16 rgb565 = ((color.red() & 0xF8) << 8) | ((color.green() & 0xFC) << 3) | (color.blue() >> 3);
-                row.append(QString("0x%1").arg(rgb565, 4, 16, QChar('0')));
+ProjectState PixelArtDialog::currentProjectState() const {
+    ProjectState state;
+    state.width = gridWidth;
+    state.height = gridHeight;
+    state.layers = layerStack.layers();
+    state.currentLayer = layerStack.currentIndex();
+    state.frames = frameStore.frames();
+    state.currentFrame = currentFrame;
+    state.pixelSize = pixelSize;
+    state.selectedColor = selectedColor;
+    for (int i = 0; i < QColorDialog::customCount(); ++i) {
+        state.palette.append(QColorDialog::customColor(i).rgba());
+    }
+    state.storage = layerStack.storage();
+    state.indexPalette = layerStack.palette();
+    state.history = history;
+    return state;
+}
+
+// projectFile is only used from the save queue until waitForIdle().
+void PixelArtDialog::saveAsProject(const QString& path) {
+    const ProjectState state = currentProjectState();
+    ProjectFile* file = &projectFile;
+    saveQueue.enqueue(path, QString("Design saved as project: %1").arg(path), [file, path, state](QString& error) {
+        if (file->save(path, state)) return true;
+        error = file->errorString();
+        return false;
+    });
+    projectPath = path;
+    setWindowTitle(QString("Pixel Art Editor - %1").arg(QFileInfo(path).fileName()));
+}
+
+void PixelArtDialog::openProject(const QString& path) {
+    ProjectState state;
+    saveQueue.waitForIdle();
+    if (!projectFile.load(path, state)) {
+        QMessageBox::warning(this, "Error!", QString("Can't open project: %1").arg(projectFile.errorString()));
+        return;
+    }
+
+    applyProjectState(state);
+    projectPath = path;
+    setWindowTitle(QString("Pixel Art Editor - %1").arg(QFileInfo(path).fileName()));
+}
+
+void PixelArtDialog::applyProjectState(const ProjectState& state) {
+    pixelSize = state.pixelSize;
+    widthInput->setValue(state.width);
+    heightInput->setValue(state.height);
+    storageInput->setCurrentIndex(storageInput->findData(int(state.storage)));
+    applySize();
+    layerStack.setPalette(state.indexPalette);
+
+    if (!state.frames.isEmpty()) {
+        frameStore.setFrames(state.width, state.height, state.frames);
+        currentFrame = state.currentFrame;
+    }
+    layerStack.setLayers(state.layers);
+    layerStack.setCurrentIndex(state.currentLayer);
+    history = state.history;
+    selectedColor = state.selectedColor;
+    for (int i = 0; i < qMin(state.palette.size(), QColorDialog::customCount()); ++i) {
+        QColorDialog::setCustomColor(i, QColor::fromRgba(state.palette[i]));
+    }
+    refreshCanvas();
+    refreshLayerPanel();
+    refreshFramePanel();
+    updateOnionSkin();
+    checkpointJournal();
+}
+
+void PixelArtDialog::checkpointJournal() {
+    journal.checkpoint(currentProjectState());
+}
+
+void PixelArtDialog::autosaveCheckpoint() {
+    if (journal.hasUncheckpointedOperations()) {
+        checkpointJournal();
+    }
+}
+
+void PixelArtDialog::restoreSession(const QString& sessionDir) {
+    ProjectState state;
+    QString error;
+    if (!AutosaveJournal::replay(sessionDir, state, error)) {
+        QMessageBox::warning(this, "Error!", QString("Can't restore session: %1").arg(error));
+        return;
+    }
+    applyProjectState(state);
+}
+
+QIcon PixelArtDialog::frameThumbnail(const TiledImage& composite) const {
+    return QIcon(QPixmap::fromImage(composite.thumbnail(QSize(48, 48))));
+}
+
+void PixelArtDialog::renumberFrames() {
+    for (int i = 0; i < frameList->count(); ++i) {
+        frameList->item(i)->setText(QString::number(i + 1));
+    }
+    removeFrameButton->setEnabled(frameList->count() > 1);
+}
+
+void PixelArtDialog::refreshFramePanel() {
+    QSignalBlocker blocker(frameList);
+    frameList->clear();
+    for (int i = 0; i < frameStore.frameCount(); ++i) {
+        TiledImage composite = i == currentFrame ? layerStack.composite() : frameStore.compositeFrame(i);
+        frameList->addItem(new QListWidgetItem(frameThumbnail(composite), QString()));
+    }
+    renumberFrames();
+    frameList->setCurrentRow(currentFrame);
+}
+
+// The frame being edited lives in layerStack; the store only holds a tiled
+// copy, refreshed whenever we leave the frame or need all frames at once.
+void PixelArtDialog::storeCurrentFrame() {
+    frameStore.storeFrame(currentFrame, layerStack.layers(), layerStack.currentIndex(), history);
+    if (QListWidgetItem* item = frameList->item(currentFrame)) {
+        item->setIcon(frameThumbnail(layerStack.composite()));
+    }
+}
+
+void PixelArtDialog::loadFrame(int index) {
+    currentFrame = index;
+    layerStack.setLayers(frameStore.expandFrame(index));
+    layerStack.setCurrentIndex(frameStore.frame(index).currentLayer);
+    history = frameStore.frame(index).history;
+    setSelection(QRect());
+    refreshCanvas();
+    refreshLayerPanel();
+    updateOnionSkin();
+    checkpointJournal();
+}
+
+void PixelArtDialog::selectFrame(int row) {
+    if (row < 0 || row == currentFrame) return;
+    storeCurrentFrame();
+    loadFrame(row);
+}
+
+void PixelArtDialog::addFrame() {
+    storeCurrentFrame();
+    Frame frame = frameStore.frame(currentFrame);
+    frame.history.clear();
+    frameStore.insertFrame(currentFrame + 1, frame);
+    {
+        QSignalBlocker blocker(frameList);
+        frameList->insertItem(currentFrame + 1, new QListWidgetItem(frameList->item(currentFrame)->icon(), QString()));
+        renumberFrames();
+        frameList->setCurrentRow(currentFrame + 1);
+    }
+    loadFrame(currentFrame + 1);
+}
+
+void PixelArtDialog::removeFrame() {
+    if (frameStore.frameCount() <= 1) return;
+    frameStore.removeFrame(currentFrame);
+    int index = qMin(currentFrame, frameStore.frameCount() - 1);
+    {
+        QSignalBlocker blocker(frameList);
+        delete frameList->takeItem(currentFrame);
+        renumberFrames();
+        frameList->setCurrentRow(index);
+    }
+    loadFrame(index);
+}
+
+void PixelArtDialog::updateOnionSkin() {
+    delete onionItem;
+    onionItem = nullptr;
+    if (!onionSkinCheckbox->isChecked() || currentFrame == 0) return;
+
+    onionItem = scene->addPixmap(QPixmap::fromImage(frameStore.compositeFrame(currentFrame - 1).toImage()));
+    onionItem->setScale(pixelSize);
+    onionItem->setOpacity(0.35);
+    onionItem->setZValue(0.5);
+}
+
+void PixelArtDialog::exportAnimation() {
+    const QString packedFilter = "Packed frames (*.txt *.h)";
+    const QString deltaFilter = "Changed rectangles per frame (*.txt *.h)";
+    QString selectedFilter;
+    QString path = QFileDialog::getSaveFileName(this, "Export animation", "", packedFilter + ";;" + deltaFilter,
+                                                &selectedFilter);
+    if (path.isEmpty()) return;
+    storeCurrentFrame();
+    if (selectedFilter == deltaFilter) {
+        saveAnimationDelta(path);
+    } else {
+        saveAnimationHex(path);
+    }
+}
+
+// The frames are snapshotted (tiles are shared, not copied) and written on the
+// save queue.
+void PixelArtDialog::saveAnimationDelta(const QString& path) {
+    const FrameStore frames = frameStore;
+    saveQueue.enqueue(path, QString("Animation saved as changed rectangles: %1").arg(path),
+                      [path, frames](QString& error) {
+        return writeAnimationDelta(frames, path, error);
+    });
+}
+
+void PixelArtDialog::saveAnimationHex(const QString& path) {
+    const FrameStore frames = frameStore;
+    saveQueue.enqueue(path, QString("Animation saved as hex code: %1").arg(path), [path, frames](QString& error) {
+        return writeAnimationHex(frames, path, error);
+    });
+}
+
+void PixelArtDialog::toggleTargetPreview(bool enabled) {
+    canvasItem->setTargetPreview(enabled);
+}
+
+void PixelArtDialog::toggleHud(bool enabled) {
+    hudEnabled = enabled;
+    hudLabel->setVisible(enabled);
+    if (enabled) {
+        hudClock.start();
+        lastPaintEnd = 0;
+        hudCurrent = HudFrame();
+        hudLast = HudFrame();
+        hudWorstFrameNs = 0;
+        updateHud();
+        hudLabel->raise();
+        hudTimer->start(250);
+    } else {
+        hudTimer->stop();
+    }
+}
+
+// Allocated tiles of the layers, the composite and the other animation
+// frames; solid tiles hold no pixels and are not counted.
+qint64 PixelArtDialog::pixelStoreBytes() const {
+    qint64 bytes = layerStack.cachedComposite().allocatedBytes() + frameStore.uniqueTileBytes();
+    for (const Layer& layer : layerStack.layers()) {
+        bytes += layer.image.allocatedBytes();
+    }
+    return bytes;
+}
+
+// Snapshots share tiles with the live layers until those are drawn on, so
+// only tiles no longer shared with the canvas (or each other) are counted.
+qint64 PixelArtDialog::historyBytes() const {
+    QSet<qint64> seen;
+    for (const Layer& layer : layerStack.layers()) {
+        for (int t = 0; t < layer.image.tileCount(); ++t) {
+            if (!layer.image.isSolid(t)) seen.insert(layer.image.tile(t).cacheKey());
+        }
+    }
+    qint64 bytes = 0;
+    for (const QVector<Layer>& snapshot : history) {
+        for (const Layer& layer : snapshot) {
+            for (int t = 0; t < layer.image.tileCount(); ++t) {
+                const QImage& tile = layer.image.tile(t);
+                if (!tile.isNull() && !seen.contains(tile.cacheKey())) {
+                    seen.insert(tile.cacheKey());
+                    bytes += tile.sizeInBytes();
+                }
             }
-            out << row.join(", ") << ",\n";
         }
-        file.close();
-        QMessageBox::information(this, "Notification", QString("Design saved as hex code: %1").arg(path));
     }
+    return bytes;
 }
 
-void PixelArtDialog::previewImage() {
-    QImage image(gridWidth, gridHeight, QImage::Format_RGB32);
-    QPainter painter(&image);
-    for (int y = 0; y < gridHeight; ++y) {
-        for (int x = 0; x < gridWidth; ++x) {
-            QColor color = pixelMatrix[y][x]->brush().color();
-            painter.fillRect(x, y, pixelSize, pixelSize, color);
-        }
+void PixelArtDialog::updateHud() {
+    auto ms = [](qint64 ns) { return QString::number(ns / 1e6, 'f', 2); };
+    auto mb = [](qint64 bytes) { return QString::number(bytes / (1024.0 * 1024.0), 'f', 2); };
+    hudLabel->setText(QString("Frame   %1 ms (worst %2)\n"
+                              "Input   %3 ms\n"
+                              "Paint   %4 ms\n"
+                              "Dirty   %5 cells\n"
+                              "Pixels  %6 MB\n"
+                              "History %7 MB (%8 steps)")
+                          .arg(ms(hudLast.frameNs), ms(hudWorstFrameNs), ms(hudLast.filterNs), ms(hudLast.paintNs))
+                          .arg(hudLast.dirtyCells)
+                          .arg(mb(pixelStoreBytes()), mb(historyBytes()))
+                          .arg(history.size()));
+    hudLabel->adjustSize();
+    hudWorstFrameNs = 0;
+}
+
+void PixelArtDialog::saveAsImage(const QString& path) {
+    const TiledImage composite = layerStack.composite();
+    const int level = pngLevelInput->currentData().toInt();
+    const bool parallel = parallelPngCheckbox->isChecked();
+    saveQueue.enqueue(path, QString("Design saved as image: %1").arg(path), [path, composite, level, parallel](QString& error) {
+        PngWriter writer;
+        writer.setCompressionLevel(level);
+        writer.setParallel(parallel);
+        if (writer.write(path, composite)) return true;
+        error = writer.errorString();
+        return false;
+    });
+}
+
+// hexFile remembers the last export, so re-saving to the same file rewrites
+// only the rows that changed.
+void PixelArtDialog::saveAsHex(const QString& path) {
+    const TiledImage composite = layerStack.composite();
+    HexExportFile* file = &hexFile;
+    saveQueue.enqueue(path, QString("Design saved as hex code: %1").arg(path), [file, path, composite](QString& error) {
+        if (file->save(path, composite)) return true;
+        error = file->errorString();
+        return false;
+    });
+}
+
+void PixelArtDialog::saveFinished(const QString& message) {
+    showNotification(message, false);
+}
+
+void PixelArtDialog::saveFailed(const QString& path, const QString& error) {
+    showNotification(QString("Can't save %1: %2").arg(path, error), true);
+}
+
+// Save outcomes are shown under the canvas; errors stay until the next one.
+void PixelArtDialog::showNotification(const QString& text, bool isError) {
+    notificationLabel->setStyleSheet(isError ? "QLabel { color: #c00000; }" : QString());
+    notificationLabel->setText(text);
+    if (isError) {
+        notificationTimer->stop();
+    } else {
+        notificationTimer->start();
     }
-    painter.end();
+}
 
-    PreviewDialog* previewDialog = new PreviewDialog(image, this);
+void PixelArtDialog::previewImage() {
+    PreviewDialog* previewDialog;
+    {
+        TRACE_SCOPE("PixelArtDialog::previewImage");
+        previewDialog = new PreviewDialog(layerStack.composite().toImage(), this);
+    }
     previewDialog->exec();
     delete previewDialog;
 }
@@ -9,18 +9,44 @@
 #include <QScrollArea>
 #include <QCheckBox>
 #include <QLabel>
+#include <QListWidget>
+#include <QComboBox>
+#include <QTimer>
 #include <QColor>
 #include <QVector>
+#include <QElapsedTimer>
+#include "layerstack.h"
+#include "projectfile.h"
+#include "hexexportfile.h"
+#include "autosavejournal.h"
+#include "framestore.h"
+#include "savequeue.h"
 
 class QGraphicsRectItem;
+class CanvasItem;
+class CanvasView;
+class QGraphicsPixmapItem;
 
 class PixelArtDialog : public QDialog {
     Q_OBJECT
 
 public:
+    // Canvas memory grows with the tiles drawn on, not with this limit.
+    static const int MaxCanvasSize = 16384;
+    // Queued mouse moves are applied at roughly display rate.
+    static const int InputFrameMs = 16;
+    static const int MaxBrushSize = 128;
+    // Opacity steps closer together than this are merged into one undo step.
+    static const int OpacityEditMs = 600;
+
     explicit PixelArtDialog(QWidget* parent = nullptr);
     ~PixelArtDialog();
 
+    void restoreSession(const QString& sessionDir);
+
+public slots:
+    void done(int result) override;
+
 protected:
     bool eventFilter(QObject* obj, QEvent* event) override;
 
@@ -32,7 +58,36 @@ private slots:
     void zoomIn();
     void zoomOut();
     void savePixelDesign();
+    void saveProject();
+    void autosaveCheckpoint();
+    void addFrame();
+    void removeFrame();
+    void selectFrame(int row);
+    void updateOnionSkin();
+    void toggleHud(bool enabled);
+    void toggleTargetPreview(bool enabled);
+    void saveFinished(const QString& message);
+    void saveFailed(const QString& path, const QString& error);
+    void updateHud();
+    void canvasPainted(qint64 paintNs);
+    void flushInput();
+    void inputFrameDue();
+    void updateBrush();
+    void exportAnimation();
     void previewImage();
+    void addLayer();
+    void removeLayer();
+    void moveLayerUp();
+    void moveLayerDown();
+    void selectLayer(int row);
+    void layerItemChanged(QListWidgetItem* item);
+    void changeLayerOpacity(int percent);
+    void finishOpacityEdit();
+    void changeBlendMode(int modeIndex);
+    void copySelection();
+    void cutSelection();
+    void pasteClipboard();
+    void toggleSelectTool(bool checked);
 
 private:
     void initUI();
@@ -41,29 +96,134 @@ private:
     void saveStateToHistory();
     void saveAsImage(const QString& path);
     void saveAsHex(const QString& path);
+    void saveAsProject(const QString& path);
+    void showNotification(const QString& text, bool isError);
+    void openProject(const QString& path);
+    QImage importHexArray(const QString& filePath);
+    QImage importRawFramebuffer(const QString& filePath);
+    ProjectState currentProjectState() const;
+    void applyProjectState(const ProjectState& state);
+    void stampBrush(const QPoint& cell, QVector<Span>& spans) const;
+    void strokeTo(const QPoint& from, const QPoint& to, QVector<Span>& spans) const;
+    void paintSpans(const QVector<Span>& spans, const QColor& color);
+    void showCoordinates(int x, int y);
+    void checkpointJournal();
+    void storeCurrentFrame();
+    void loadFrame(int index);
+    void refreshFramePanel();
+    void renumberFrames();
+    QIcon frameThumbnail(const TiledImage& composite) const;
+    void saveAnimationHex(const QString& path);
+    void saveAnimationDelta(const QString& path);
+    bool cellAt(const QPointF& pos, int& x, int& y) const;
+    QPoint cellFromScene(const QPointF& pos) const;
+    void setSelection(const QRect& rect);
+    void selectionPress(const QPoint& cell);
+    void selectionDrag(const QPoint& cell);
+    void selectionRelease(const QPoint& cell);
+    void refreshCanvas();
+    bool filterCanvasEvent(QObject* obj, QEvent* event);
+    qint64 pixelStoreBytes() const;
+    qint64 historyBytes() const;
+    void refreshLayerPanel();
+    void updateLayerControls();
+    int layerIndexForRow(int row) const;
 
     int pixelSize;
     int gridWidth;
     int gridHeight;
     bool isDrawing;
     QColor selectedColor;
-    QVector<QVector<QGraphicsRectItem*>> pixelMatrix;
-    QVector<QVector<QColor>> history;
+    CanvasItem* canvasItem;
+    LayerStack layerStack;
+    QVector<QVector<Layer>> history;
+    ProjectFile projectFile;
+    HexExportFile hexFile;
+    AutosaveJournal journal;
+    SaveQueue saveQueue; // after projectFile and hexFile, so pending saves finish first
+    QVector<SpanWrite> strokeWrites;
+
+    enum BrushShape { SquareBrush, RoundBrush };
+    enum Symmetry { MirrorX = 1, MirrorY = 2 };
+    QVector<Span> brushStamp; // one span per row, relative to the cell under the cursor
+
+    // Mouse moves are queued here and applied once per frame tick.
+    QVector<QPoint> pendingCells;
+    Qt::MouseButtons pendingButtons;
+    QPoint lastStrokeCell;
+    QTimer* inputTimer;
+    QTimer* autosaveTimer;
+    QTimer* opacityEditTimer;
+    int opacityEditLayer; // layer of the opacity edit in progress, or -1
+    FrameStore frameStore;
+    int currentFrame;
+    QGraphicsPixmapItem* onionItem;
+
+    // Performance HUD; one HudFrame is accumulated between two canvas repaints.
+    struct HudFrame {
+        qint64 frameNs = 0;
+        qint64 filterNs = 0;
+        qint64 paintNs = 0;
+        int dirtyCells = 0;
+    };
+    bool hudEnabled;
+    QElapsedTimer hudClock;
+    qint64 lastPaintEnd;
+    HudFrame hudCurrent;
+    HudFrame hudLast;
+    qint64 hudWorstFrameNs;
+    QTimer* hudTimer;
+    QLabel* hudLabel;
+    QString projectPath;
+    QRect selection;
+    QPoint selectionAnchor;
+    QPoint moveOrigin;
+    bool isMovingSelection;
+    QImage floatingImage;
+    QImage clipboardImage;
+    QGraphicsRectItem* selectionItem;
+    QGraphicsPixmapItem* floatingItem;
     QGraphicsScene* scene;
-    QGraphicsView* view;
+    CanvasView* view;
     QScrollArea* scrollArea;
     QSpinBox* widthInput;
     QSpinBox* heightInput;
     QPushButton* applySizeButton;
     QPushButton* openImageButton;
+    QComboBox* storageInput;
+    QCheckBox* targetPreviewCheckbox;
     QPushButton* colorButton;
     QPushButton* undoButton;
     QPushButton* saveDesignButton;
     QPushButton* zoomInButton;
     QPushButton* zoomOutButton;
     QPushButton* previewButton;
+    QComboBox* pngLevelInput;
+    QCheckBox* parallelPngCheckbox;
+    QPushButton* selectToolButton;
+    QPushButton* copyButton;
+    QPushButton* cutButton;
+    QPushButton* pasteButton;
+    QSpinBox* brushSizeInput;
+    QComboBox* brushShapeInput;
+    QComboBox* symmetryInput;
     QCheckBox* coordinateCheckbox;
     QLabel* coordinatesLabel;
+    QLabel* notificationLabel;
+    QTimer* notificationTimer;
+    QListWidget* layerList;
+    QPushButton* addLayerButton;
+    QPushButton* removeLayerButton;
+    QPushButton* layerUpButton;
+    QPushButton* layerDownButton;
+    QSpinBox* opacityInput;
+    QComboBox* blendModeInput;
+    QListWidget* frameList;
+    QPushButton* addFrameButton;
+    QPushButton* removeFrameButton;
+    QPushButton* exportAnimationButton;
+    QCheckBox* onionSkinCheckbox;
+    QCheckBox* hudCheckbox;
 };
 
 #endif // PIXELARTDIALOG_H
@@ -0,0 +1,19 @@
+#include "pixelbuffer.h"
+
+QImage::Format pixelFormatToImageFormat(PixelFormat format) {
+    switch (format) {
+    case PixelFormat::Rgb565: return QImage::Format_RGB16;
+    case PixelFormat::Rgb888: return QImage::Format_RGB888;
+    case PixelFormat::Argb32: break;
+    }
+    return QImage::Format_ARGB32;
+}
+
+int pixelFormatBytes(PixelFormat format) {
+    switch (format) {
+    case PixelFormat::Rgb565: return 2;
+    case PixelFormat::Rgb888: return 3;
+    case PixelFormat::Argb32: break;
+    }
+    return 4;
+}
@@ -0,0 +1,17 @@
+#ifndef PIXELBUFFER_H
+#define PIXELBUFFER_H
+
+#include <QImage>
+
+// Layouts of plain pixel buffers that arrive without a QImage around them,
+// such as raw framebuffer dumps.
+enum class PixelFormat {
+    Rgb565, // one quint16 per pixel, native byte order
+    Rgb888, // R, G, B bytes
+    Argb32  // one QRgb per pixel, not premultiplied
+};
+
+QImage::Format pixelFormatToImageFormat(PixelFormat format);
+int pixelFormatBytes(PixelFormat format);
+
+#endif // PIXELBUFFER_H
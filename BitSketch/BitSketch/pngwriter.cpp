@@ -0,0 +1,216 @@
+#include "pngwriter.h"
+#include "rgb565.h"
+#include "trace.h"
+#include "workpool.h"
+#include <QSaveFile>
+#include <QThread>
+#include <QVector>
+#include <zlib.h>
+
+namespace {
+
+const int WindowBytes = 32768;
+
+struct Band {
+    int firstRow;
+    int endRow;
+    QByteArray deflated;
+    uLong adler;
+    uLong length;
+    bool ok;
+};
+
+int channelsFor(QImage::Format format) {
+    return format == QImage::Format_ARGB32_Premultiplied ? 4 : 3;
+}
+
+// Filtered PNG rows (filter type 0, then the pixels) for [firstRow, endRow).
+QByteArray rowBytes(const TiledImage& image, int firstRow, int endRow) {
+    const int width = image.width();
+    const int channels = channelsFor(image.format());
+    const int stride = 1 + width * channels;
+    QByteArray bytes(stride * (endRow - firstRow), Qt::Uninitialized);
+    QVector<QRgb> line(width);
+    QVector<quint16> packed(image.format() == QImage::Format_RGB16 ? width : 0);
+    for (int y = firstRow; y < endRow; ++y) {
+        uchar* out = reinterpret_cast<uchar*>(bytes.data()) + (y - firstRow) * stride;
+        *out++ = 0;
+        if (image.format() == QImage::Format_RGB16) {
+            image.readLine(0, y, width, packed.data());
+            for (int x = 0; x < width; ++x) {
+                line[x] = fromRgb565(packed[x]);
+            }
+        } else {
+            image.readLine(0, y, width, line.data());
+        }
+        if (channels == 4) {
+            for (int x = 0; x < width; ++x) {
+                const QRgb color = qUnpremultiply(line[x]);
+                *out++ = qRed(color);
+                *out++ = qGreen(color);
+                *out++ = qBlue(color);
+                *out++ = qAlpha(color);
+            }
+        } else {
+            for (int x = 0; x < width; ++x) {
+                *out++ = qRed(line[x]);
+                *out++ = qGreen(line[x]);
+                *out++ = qBlue(line[x]);
+            }
+        }
+    }
+    return bytes;
+}
+
+// The preceding rows are rebuilt rather than shared between bands, so bands
+// can be compressed in any order.
+void compressBand(const TiledImage& image, int level, bool last, Band& band) {
+    const QByteArray raw = rowBytes(image, band.firstRow, band.endRow);
+    band.adler = adler32(adler32(0, Z_NULL, 0), reinterpret_cast<const Bytef*>(raw.constData()), raw.size());
+    band.length = raw.size();
+    band.ok = false;
+
+    z_stream stream = {};
+    if (deflateInit2(&stream, level, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) return;
+    if (band.firstRow > 0) {
+        const int stride = 1 + image.width() * channelsFor(image.format());
+        const int dictionaryRows = qMin(band.firstRow, (WindowBytes + stride - 1) / stride);
+        const QByteArray dictionary = rowBytes(image, band.firstRow - dictionaryRows, band.firstRow).right(WindowBytes);
+        deflateSetDictionary(&stream, reinterpret_cast<const Bytef*>(dictionary.constData()), dictionary.size());
+    }
+
+    const int flush = last ? Z_FINISH : Z_SYNC_FLUSH;
+    band.deflated.resize(int(deflateBound(&stream, raw.size())) + 64);
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(raw.constData()));
+    stream.avail_in = raw.size();
+    int written = 0;
+    int status;
+    do {
+        if (written == band.deflated.size()) band.deflated.resize(band.deflated.size() * 2);
+        stream.next_out = reinterpret_cast<Bytef*>(band.deflated.data()) + written;
+        stream.avail_out = band.deflated.size() - written;
+        status = deflate(&stream, flush);
+        written = band.deflated.size() - stream.avail_out;
+    } while (status == Z_OK && stream.avail_out == 0);
+    deflateEnd(&stream);
+
+    band.deflated.resize(written);
+    band.ok = last ? status == Z_STREAM_END : status == Z_OK || status == Z_BUF_ERROR;
+}
+
+void appendBigEndian(QByteArray& out, quint32 value) {
+    out.append(char(value >> 24));
+    out.append(char(value >> 16));
+    out.append(char(value >> 8));
+    out.append(char(value));
+}
+
+void writeChunk(QSaveFile& file, const char* type, const QByteArray& data) {
+    QByteArray head;
+    appendBigEndian(head, data.size());
+    head.append(type, 4);
+    uLong crc = crc32(crc32(0, Z_NULL, 0), reinterpret_cast<const Bytef*>(type), 4);
+    crc = crc32(crc, reinterpret_cast<const Bytef*>(data.constData()), data.size());
+    QByteArray tail;
+    appendBigEndian(tail, crc);
+    file.write(head);
+    file.write(data);
+    file.write(tail);
+}
+
+// CMF/FLG pair for a 32 KB window; FLEVEL only records the level used.
+QByteArray zlibHeader(int level) {
+    const int cmf = 0x78;
+    const int flevel = level < 2 ? 0 : level < 6 ? 1 : level == 6 ? 2 : 3;
+    int flg = flevel << 6;
+    flg += 31 - (cmf * 256 + flg) % 31;
+    QByteArray header;
+    header.append(char(cmf));
+    header.append(char(flg));
+    return header;
+}
+
+} // namespace
+
+PngWriter::PngWriter() : level(DefaultLevel), parallel(true) {}
+
+void PngWriter::setCompressionLevel(int compressionLevel) {
+    level = qBound(0, compressionLevel, 9);
+}
+
+void PngWriter::setParallel(bool enabled) {
+    parallel = enabled;
+}
+
+bool PngWriter::write(const QString& path, const TiledImage& image) {
+    TRACE_SCOPE("PngWriter::write");
+    error.clear();
+    const QImage::Format format = image.format();
+    if (image.isNull() || (format != QImage::Format_RGB32 && format != QImage::Format_RGB16
+                           && format != QImage::Format_ARGB32_Premultiplied)) {
+        error = "Unsupported image.";
+        return false;
+    }
+
+    const int stride = 1 + image.width() * channelsFor(format);
+    const int rowsPerBand = qMax(1, BandBytes / stride);
+    QVector<Band> bands;
+    for (int y = 0; y < image.height(); y += rowsPerBand) {
+        Band band;
+        band.firstRow = y;
+        band.endRow = qMin(image.height(), y + rowsPerBand);
+        bands.append(band);
+    }
+
+    const int compressionLevel = level;
+    if (parallel && bands.size() > 1 && QThread::idealThreadCount() > 1) {
+        WorkStealingPool pool(qMin(bands.size(), QThread::idealThreadCount()));
+        for (int i = 0; i < bands.size(); ++i) {
+            Band* band = &bands[i];
+            const bool last = i + 1 == bands.size();
+            pool.submit([&image, compressionLevel, last, band] { compressBand(image, compressionLevel, last, *band); });
+        }
+        pool.waitForDone();
+    } else {
+        for (int i = 0; i < bands.size(); ++i) {
+            compressBand(image, compressionLevel, i + 1 == bands.size(), bands[i]);
+        }
+    }
+
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        error = file.errorString();
+        return false;
+    }
+    file.write("\x89PNG\r\n\x1a\n", 8);
+
+    QByteArray header;
+    appendBigEndian(header, image.width());
+    appendBigEndian(header, image.height());
+    header.append(char(8));
+    header.append(char(channelsFor(format) == 4 ? 6 : 2));
+    header.append(char(0)); // deflate
+    header.append(char(0)); // adaptive filtering
+    header.append(char(0)); // no interlace
+    writeChunk(file, "IHDR", header);
+
+    uLong adler = adler32(0, Z_NULL, 0);
+    for (int i = 0; i < bands.size(); ++i) {
+        if (!bands[i].ok) {
+            error = "Compression failed.";
+            file.cancelWriting();
+            return false;
+        }
+        adler = adler32_combine(adler, bands[i].adler, bands[i].length);
+        QByteArray data = i == 0 ? zlibHeader(level) + bands[i].deflated : bands[i].deflated;
+        if (i + 1 == bands.size()) appendBigEndian(data, adler);
+        writeChunk(file, "IDAT", data);
+    }
+    writeChunk(file, "IEND", QByteArray());
+
+    if (!file.commit()) {
+        error = file.errorString();
+        return false;
+    }
+    return true;
+}
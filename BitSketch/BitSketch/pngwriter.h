@@ -0,0 +1,32 @@
+#ifndef PNGWRITER_H
+#define PNGWRITER_H
+
+#include <QString>
+#include "tiledimage.h"
+
+// Writes a TiledImage as an 8-bit PNG straight from its tile rows: RGB for
+// the opaque composite formats (Format_RGB32, Format_RGB16), RGBA for
+// Format_ARGB32_Premultiplied. Rows are deflated in bands of roughly
+// BandBytes. With parallel compression the bands run on a WorkStealingPool,
+// pigz-style: every band is a raw deflate stream primed with the 32 KB of
+// rows before it and ended on a byte boundary, so the bands concatenate into
+// one zlib stream whose Adler-32 is combined from the per-band checksums.
+class PngWriter {
+public:
+    static const int DefaultLevel = 6;
+    static const int BandBytes = 256 * 1024;
+
+    PngWriter();
+
+    void setCompressionLevel(int level); // 0 (stored) .. 9 (smallest)
+    void setParallel(bool enabled);
+    bool write(const QString& path, const TiledImage& image);
+    QString errorString() const { return error; }
+
+private:
+    int level;
+    bool parallel;
+    QString error;
+};
+
+#endif // PNGWRITER_H
@@ -1,4 +1,5 @@
 #include "previewdialog.h"
+#include "trace.h"
 #include <QWheelEvent>
 #include <QMouseEvent>
 
@@ -28,6 +29,7 @@ void PreviewDialog::wheelEvent(QWheelEvent* event) {
 }
 
 void PreviewDialog::updateImageLabel() {
+    TRACE_SCOPE("PreviewDialog::updateImageLabel");
     QImage scaledImage = image.scaled(image.size() * scaleFactor, Qt::KeepAspectRatio, Qt::SmoothTransformation);
     imageLabel->setPixmap(QPixmap::fromImage(scaledImage));
     imageLabel->resize(scaledImage.size());
@@ -0,0 +1,738 @@
+#include "projectfile.h"
+#include <QDataStream>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QSet>
+#include <QSaveFile>
+#include <algorithm>
+#include <cstring>
+
+#if defined(Q_OS_UNIX)
+#include <unistd.h>
+#elif defined(Q_OS_WIN)
+#include <io.h>
+#endif
+
+namespace {
+
+const quint32 Magic = 0x314B5342; // "BSK1"
+const quint32 Version = 1;
+const int HeaderSize = 64;
+const int EntrySize = 24;
+
+enum TileEncoding : quint32 {
+    RawTile = 0,
+    ZlibTile = 1,
+    SolidTile = 2
+};
+
+struct Header {
+    quint32 width;
+    quint32 height;
+    quint32 tileSize;
+    quint32 layerCount; // layer slots over all frames
+    quint64 directoryOffset;
+    quint64 metadataOffset;
+    quint32 metadataSize;
+};
+
+// QImage pads rows to 4 bytes; files hold the rows packed.
+QByteArray tileBytes(const QImage& tile) {
+    const int rowBytes = tile.width() * tile.depth() / 8;
+    if (rowBytes == tile.bytesPerLine()) {
+        return QByteArray(reinterpret_cast<const char*>(tile.constBits()), tile.sizeInBytes());
+    }
+    QByteArray bytes(rowBytes * tile.height(), Qt::Uninitialized);
+    for (int y = 0; y < tile.height(); ++y) {
+        memcpy(bytes.data() + y * rowBytes, tile.constScanLine(y), rowBytes);
+    }
+    return bytes;
+}
+
+int packedSize(const QRect& rect, QImage::Format format) {
+    return rect.width() * rect.height() * (QImage::toPixelFormat(format).bitsPerPixel() / 8);
+}
+
+// The inverse of tileBytes(); padding is zeroed so tiles compare bytewise.
+QImage unpackTile(const char* data, const QSize& size, QImage::Format format) {
+    QImage tile(size, format);
+    memset(tile.bits(), 0, tile.sizeInBytes());
+    const int rowBytes = size.width() * (tile.depth() / 8);
+    for (int y = 0; y < size.height(); ++y) {
+        memcpy(tile.scanLine(y), data + y * rowBytes, rowBytes);
+    }
+    return tile;
+}
+
+TiledImage emptyLayerImage(const ProjectState& state) {
+    TiledImage image(state.width, state.height, LayerStack::layerFormat(state.storage),
+                     LayerStack::transparentValue(state.storage));
+    if (state.storage == PixelStorage::Indexed8) image.setColorTable(state.indexPalette);
+    return image;
+}
+
+bool tilesEqual(const QImage& a, const QImage& b) {
+    if (a.cacheKey() == b.cacheKey()) return true;
+    return a.size() == b.size() && memcmp(a.constBits(), b.constBits(), a.sizeInBytes()) == 0;
+}
+
+bool tilesEqual(const TiledImage& a, const TiledImage& b, int index) {
+    if (a.isSolid(index) || b.isSolid(index)) {
+        return a.isSolid(index) && b.isSolid(index) && a.fillValue(index) == b.fillValue(index);
+    }
+    return tilesEqual(a.tile(index), b.tile(index));
+}
+
+// Uniform tiles are stored as their pixel value alone; zlib is only kept when it
+// saves at least a quarter of the raw size, so decoding stays cheap.
+QByteArray encodeTile(const TiledImage& image, int index, ProjectFile::TileEntry& entry) {
+    if (image.isSolid(index)) {
+        entry.encoding = SolidTile;
+        entry.fill = image.fillValue(index);
+        entry.size = 0;
+        return QByteArray();
+    }
+
+    const QImage& tile = image.tile(index);
+    uint fill;
+    if (TiledImage::isUniform(tile, &fill)) {
+        entry.encoding = SolidTile;
+        entry.fill = fill;
+        entry.size = 0;
+        return QByteArray();
+    }
+
+    QByteArray raw = tileBytes(tile);
+    QByteArray compressed = qCompress(raw, 1);
+    entry.fill = 0;
+    if (compressed.size() < raw.size() * 3 / 4) {
+        entry.encoding = ZlibTile;
+        entry.size = compressed.size();
+        return compressed;
+    }
+    entry.encoding = RawTile;
+    entry.size = raw.size();
+    return raw;
+}
+
+// Layer slots in file order: every layer of frame 0, then frame 1, ... The
+// frame being edited is taken from the live layers.
+QVector<TiledImage> collectSlots(const ProjectState& state) {
+    QVector<TiledImage> layerSlots;
+    const int frameCount = qMax(1, state.frames.size());
+    for (int f = 0; f < frameCount; ++f) {
+        if (f == state.currentFrame || state.frames.isEmpty()) {
+            for (const Layer& layer : state.layers) {
+                layerSlots.append(layer.image);
+            }
+        } else {
+            for (const Layer& layer : state.frames[f].layers) {
+                layerSlots.append(layer.image);
+            }
+        }
+    }
+    return layerSlots;
+}
+
+void writeHeader(QIODevice* device, const Header& header) {
+    QByteArray block(HeaderSize, '\0');
+    QDataStream out(&block, QIODevice::WriteOnly);
+    out.setByteOrder(QDataStream::LittleEndian);
+    out << Magic << Version << header.width << header.height << header.tileSize << header.layerCount
+        << header.directoryOffset << header.metadataOffset << header.metadataSize;
+    device->seek(0);
+    device->write(block);
+}
+
+void writeDirectory(QIODevice* device, quint64 offset, const QVector<ProjectFile::TileEntry>& directory) {
+    QByteArray block;
+    block.reserve(directory.size() * EntrySize);
+    QDataStream out(&block, QIODevice::WriteOnly);
+    out.setByteOrder(QDataStream::LittleEndian);
+    for (const ProjectFile::TileEntry& entry : directory) {
+        out << entry.offset << entry.size << entry.capacity << entry.encoding << entry.fill;
+    }
+    device->seek(offset);
+    device->write(block);
+}
+
+template <typename LayerType>
+void writeLayerInfo(QDataStream& out, const LayerType& layer) {
+    out << layer.name << layer.visible << qint32(layer.opacity) << qint32(layer.blendMode);
+}
+
+template <typename LayerType>
+void readLayerInfo(QDataStream& in, LayerType& layer) {
+    qint32 opacity, blendMode;
+    in >> layer.name >> layer.visible >> opacity >> blendMode;
+    layer.opacity = qBound(0, int(opacity), 255);
+    layer.blendMode = static_cast<BlendMode>(qBound(0, int(blendMode), int(BlendMode::Add)));
+}
+
+// Layers as identities: the same infos and the same tile images (shared, not
+// merely equal), so a snapshot is recognised without reading its pixels.
+bool sameTile(const TiledImage& a, const TiledImage& b, int index) {
+    if (a.isSolid(index) || b.isSolid(index)) {
+        return a.isSolid(index) && b.isSolid(index) && a.fillValue(index) == b.fillValue(index);
+    }
+    return a.tile(index).cacheKey() == b.tile(index).cacheKey();
+}
+
+bool sameLayers(const QVector<Layer>& a, const QVector<Layer>& b) {
+    if (a.size() != b.size()) return false;
+    for (int i = 0; i < a.size(); ++i) {
+        const Layer& x = a[i];
+        const Layer& y = b[i];
+        if (x.name != y.name || x.visible != y.visible || x.opacity != y.opacity || x.blendMode != y.blendMode
+            || x.image.size() != y.image.size() || x.image.format() != y.image.format()) {
+            return false;
+        }
+        for (int t = 0; t < x.image.tileCount(); ++t) {
+            if (!sameTile(x.image, y.image, t)) return false;
+        }
+    }
+    return true;
+}
+
+// The newest MaxSavedHistory snapshots at the canvas size, oldest first.
+QVector<int> keptHistory(const ProjectState& state) {
+    const QSize size(state.width, state.height);
+    QVector<int> kept;
+    for (int h = state.history.size() - 1; h >= 0 && kept.size() < ProjectFile::MaxSavedHistory; --h) {
+        const QVector<Layer>& snapshot = state.history[h];
+        if (std::all_of(snapshot.begin(), snapshot.end(), [&](const Layer& l) { return l.image.size() == size; })) {
+            kept.prepend(h);
+        }
+    }
+    return kept;
+}
+
+// One history chunk: the snapshot's layers with only the tiles that differ
+// from its successor (the next newer snapshot, or the live layers for the
+// newest). A chunk therefore stays valid until its snapshot or successor
+// changes, which is rarely more than the newest one or two per save.
+QByteArray encodeSnapshot(const QVector<Layer>& snapshot, const QVector<Layer>& successor) {
+    QByteArray block;
+    QDataStream out(&block, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_5_0);
+    out << qint32(snapshot.size());
+    for (int i = 0; i < snapshot.size(); ++i) {
+        const Layer& layer = snapshot[i];
+        writeLayerInfo(out, layer);
+        const bool comparable = i < successor.size();
+        QVector<int> changed;
+        for (int t = 0; t < layer.image.tileCount(); ++t) {
+            if (!comparable || !tilesEqual(layer.image, successor[i].image, t)) changed.append(t);
+        }
+        out << qint32(changed.size());
+        for (int t : changed) {
+            out << qint32(t) << qCompress(tileBytes(layer.image.tileImage(t)), 1);
+        }
+    }
+    return block;
+}
+
+// Reads the per-layer infos and changed tiles written by encodeSnapshot();
+// unchanged tiles come from base.
+bool readSnapshot(QDataStream& in, const ProjectState& state, const QVector<Layer>& base, QVector<Layer>& snapshot) {
+    const int tileCount = LayerStack::tileCount(state.width, state.height);
+    qint32 layerCount;
+    in >> layerCount;
+    snapshot.clear();
+    for (int i = 0; i < layerCount && in.status() == QDataStream::Ok; ++i) {
+        Layer layer;
+        readLayerInfo(in, layer);
+        layer.image = i < base.size() ? base[i].image : emptyLayerImage(state);
+
+        qint32 changedCount;
+        in >> changedCount;
+        for (int c = 0; c < changedCount && in.status() == QDataStream::Ok; ++c) {
+            qint32 index;
+            QByteArray tile;
+            in >> index >> tile;
+            if (index < 0 || index >= tileCount) return false;
+            QRect rect = LayerStack::tileRect(index, state.width, state.height);
+            QByteArray raw = qUncompress(tile);
+            if (raw.size() != packedSize(rect, layer.image.format())) return false;
+            layer.image.setTile(index, unpackTile(raw.constData(), rect.size(), layer.image.format()));
+            layer.image.squeezeTile(index);
+        }
+        snapshot.append(layer);
+    }
+    return in.status() == QDataStream::Ok;
+}
+
+QByteArray encodeMetadata(const ProjectState& state, const QVector<ProjectFile::HistoryChunk>& history) {
+    QByteArray block;
+    QDataStream out(&block, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_5_0);
+    const int frameCount = qMax(1, state.frames.size());
+    out << qint32(state.pixelSize) << state.selectedColor << state.palette
+        << qint32(state.storage) << state.indexPalette
+        << qint32(state.currentFrame) << qint32(frameCount);
+    for (int f = 0; f < frameCount; ++f) {
+        if (f == state.currentFrame || state.frames.isEmpty()) {
+            out << qint32(state.currentLayer) << qint32(state.layers.size());
+            for (const Layer& layer : state.layers) {
+                writeLayerInfo(out, layer);
+            }
+        } else {
+            const Frame& frame = state.frames[f];
+            out << qint32(frame.currentLayer) << qint32(frame.layers.size());
+            for (const Layer& layer : frame.layers) {
+                writeLayerInfo(out, layer);
+            }
+        }
+    }
+    out << qint32(history.size());
+    for (const ProjectFile::HistoryChunk& chunk : history) {
+        out << chunk.offset << chunk.size;
+    }
+    return qCompress(block, 1);
+}
+
+// Flushes and, where the platform allows, syncs the data written so far, so
+// it is on disk before the header that points at it.
+bool syncFile(QFile& file) {
+    if (!file.flush()) return false;
+#if defined(Q_OS_UNIX)
+    return fsync(file.handle()) == 0;
+#elif defined(Q_OS_WIN)
+    return _commit(file.handle()) == 0;
+#else
+    return true;
+#endif
+}
+
+} // namespace
+
+ProjectFile::ProjectFile()
+    : savedWidth(0), savedHeight(0), savedStorage(PixelStorage::Argb32), metadataSize(0), deadBytes(0) {}
+
+bool ProjectFile::save(const QString& path, const ProjectState& state) {
+    error.clear();
+    const QVector<TiledImage> layerSlots = collectSlots(state);
+    if (canWriteIncremental(path, state, layerSlots)) {
+        return writeIncremental(path, state, layerSlots);
+    }
+    return writeFull(path, state, layerSlots);
+}
+
+bool ProjectFile::canWriteIncremental(const QString& path, const ProjectState& state,
+                                      const QVector<TiledImage>& layerSlots) const {
+    if (path != lastPath || state.width != savedWidth || state.height != savedHeight) return false;
+    if (state.storage != savedStorage) return false;
+    if (layerSlots.size() != savedSlots.size()) return false;
+    QFileInfo info(path);
+    if (!info.exists() || info.lastModified() != lastModified) return false;
+    return deadBytes * 100 <= quint64(info.size()) * MaxDeadPercent;
+}
+
+void ProjectFile::remember(const QString& path, const ProjectState& state, const QVector<TiledImage>& layerSlots) {
+    lastPath = path;
+    lastModified = QFileInfo(path).lastModified();
+    savedWidth = state.width;
+    savedHeight = state.height;
+    savedStorage = state.storage;
+    savedSlots = layerSlots;
+}
+
+// Writes a chunk for every kept snapshot at end, except, when reusing, those
+// whose snapshot and successor are unchanged since the last save to this
+// file: their chunks are still in place.
+QVector<ProjectFile::HistoryChunk> ProjectFile::appendHistory(QIODevice* device, const ProjectState& state,
+                                                              quint64& end, bool reuse) const {
+    const QVector<int> kept = keptHistory(state);
+    QVector<HistoryChunk> chunks;
+    int searchFrom = 0;
+    for (int k = 0; k < kept.size(); ++k) {
+        HistoryChunk chunk;
+        chunk.snapshot = state.history[kept[k]];
+        chunk.successor = k + 1 < kept.size() ? state.history[kept[k + 1]] : state.layers;
+
+        // Snapshots keep their order, so the search resumes after the last match.
+        bool found = false;
+        for (int j = searchFrom; reuse && j < savedHistory.size() && !found; ++j) {
+            const HistoryChunk& saved = savedHistory[j];
+            if (sameLayers(saved.snapshot, chunk.snapshot) && sameLayers(saved.successor, chunk.successor)) {
+                chunk.offset = saved.offset;
+                chunk.size = saved.size;
+                searchFrom = j + 1;
+                found = true;
+            }
+        }
+        if (!found) {
+            const QByteArray block = encodeSnapshot(chunk.snapshot, chunk.successor);
+            device->seek(end);
+            device->write(block);
+            chunk.offset = end;
+            chunk.size = block.size();
+            end += block.size();
+        }
+        chunks.append(chunk);
+    }
+    return chunks;
+}
+
+// Identical tiles (shared images or equal bytes) are written once and their
+// directory entries point at the same slot.
+bool ProjectFile::writeFull(const QString& path, const ProjectState& state, const QVector<TiledImage>& layerSlots) {
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        error = file.errorString();
+        return false;
+    }
+
+    const int tileCount = LayerStack::tileCount(state.width, state.height);
+    QVector<TileEntry> entries(layerSlots.size() * tileCount);
+    QHash<qint64, int> writtenImages;
+    QMultiHash<uint, int> written;
+    quint64 offset = HeaderSize;
+    file.seek(offset);
+    for (int s = 0; s < layerSlots.size(); ++s) {
+        for (int t = 0; t < tileCount; ++t) {
+            const int index = s * tileCount + t;
+            TileEntry& entry = entries[index];
+            if (layerSlots[s].isSolid(t)) {
+                encodeTile(layerSlots[s], t, entry);
+                entry.offset = 0;
+                entry.capacity = 0;
+                continue;
+            }
+
+            const QImage& tile = layerSlots[s].tile(t);
+            if (writtenImages.contains(tile.cacheKey())) {
+                entry = entries[writtenImages.value(tile.cacheKey())];
+                continue;
+            }
+            writtenImages.insert(tile.cacheKey(), index);
+
+            const uint hash = qHashBits(tile.constBits(), tile.sizeInBytes());
+            bool reused = false;
+            for (auto it = written.constFind(hash); it != written.constEnd() && it.key() == hash; ++it) {
+                const int other = it.value();
+                if (tilesEqual(layerSlots[other / tileCount].tile(other % tileCount), tile)) {
+                    entry = entries[other];
+                    reused = true;
+                    break;
+                }
+            }
+            if (reused) continue;
+
+            QByteArray payload = encodeTile(layerSlots[s], t, entry);
+            entry.offset = payload.isEmpty() ? 0 : offset;
+            entry.capacity = payload.size();
+            if (!payload.isEmpty()) {
+                file.write(payload);
+                offset += payload.size();
+            }
+            written.insert(hash, index);
+        }
+    }
+
+    const QVector<HistoryChunk> history = appendHistory(&file, state, offset, false);
+    const QByteArray metadata = encodeMetadata(state, history);
+
+    Header header;
+    header.width = state.width;
+    header.height = state.height;
+    header.tileSize = LayerStack::TileSize;
+    header.layerCount = layerSlots.size();
+    header.directoryOffset = offset;
+    header.metadataOffset = header.directoryOffset + quint64(entries.size()) * EntrySize;
+    header.metadataSize = metadata.size();
+
+    writeDirectory(&file, header.directoryOffset, entries);
+    file.seek(header.metadataOffset);
+    file.write(metadata);
+    writeHeader(&file, header);
+    if (!file.commit()) {
+        error = file.errorString();
+        return false;
+    }
+
+    directory = entries;
+    savedHistory = history;
+    metadataSize = metadata.size();
+    deadBytes = 0;
+    remember(path, state, layerSlots);
+    return true;
+}
+
+// Tiles whose bytes match the last saved state are skipped; changed tiles,
+// new history chunks, the directory and the metadata are appended, and the
+// header switches over to them once they are on disk. Slots and chunks that
+// nothing points at any more are counted as dead bytes.
+bool ProjectFile::writeIncremental(const QString& path, const ProjectState& state,
+                                   const QVector<TiledImage>& layerSlots) {
+    QFile file(path);
+    if (!file.open(QIODevice::ReadWrite)) {
+        error = file.errorString();
+        return false;
+    }
+
+    QHash<quint64, int> slotUsers;
+    for (const TileEntry& entry : directory) {
+        if (entry.capacity > 0) ++slotUsers[entry.offset];
+    }
+
+    const int tileCount = LayerStack::tileCount(state.width, state.height);
+    QVector<TileEntry> entries = directory;
+    quint64 dead = deadBytes;
+    quint64 end = file.size();
+    file.seek(end);
+    for (int s = 0; s < layerSlots.size(); ++s) {
+        for (int t = 0; t < tileCount; ++t) {
+            if (tilesEqual(layerSlots[s], savedSlots[s], t)) continue;
+
+            TileEntry& entry = entries[s * tileCount + t];
+            if (entry.capacity > 0 && --slotUsers[entry.offset] == 0) dead += entry.capacity;
+            QByteArray payload = encodeTile(layerSlots[s], t, entry);
+            entry.offset = payload.isEmpty() ? 0 : end;
+            entry.capacity = payload.size();
+            if (payload.isEmpty()) continue;
+            file.write(payload);
+            end += payload.size();
+        }
+    }
+
+    const QVector<HistoryChunk> history = appendHistory(&file, state, end, true);
+    QSet<quint64> keptChunks;
+    for (const HistoryChunk& chunk : history) {
+        keptChunks.insert(chunk.offset);
+    }
+    for (const HistoryChunk& chunk : savedHistory) {
+        if (!keptChunks.contains(chunk.offset)) dead += chunk.size;
+    }
+
+    const QByteArray metadata = encodeMetadata(state, history);
+    Header header;
+    header.width = state.width;
+    header.height = state.height;
+    header.tileSize = LayerStack::TileSize;
+    header.layerCount = layerSlots.size();
+    header.directoryOffset = end;
+    header.metadataOffset = header.directoryOffset + quint64(entries.size()) * EntrySize;
+    header.metadataSize = metadata.size();
+    writeDirectory(&file, header.directoryOffset, entries);
+    file.seek(header.metadataOffset);
+    file.write(metadata);
+    dead += quint64(directory.size()) * EntrySize + metadataSize;
+
+    // The previous save stays the valid one until the header is replaced.
+    if (file.error() != QFileDevice::NoError || !syncFile(file)) {
+        error = file.errorString();
+        return false;
+    }
+    writeHeader(&file, header);
+    const bool ok = file.error() == QFileDevice::NoError && syncFile(file);
+    if (!ok) error = file.errorString();
+    file.close();
+    if (!ok) {
+        lastPath.clear();
+        return false;
+    }
+
+    directory = entries;
+    savedHistory = history;
+    metadataSize = metadata.size();
+    deadBytes = dead;
+    remember(path, state, layerSlots);
+    return true;
+}
+
+bool ProjectFile::load(const QString& path, ProjectState& state) {
+    error.clear();
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        error = file.errorString();
+        return false;
+    }
+    const qint64 fileSize = file.size();
+    if (fileSize < HeaderSize) {
+        error = "File is too small to be a BitSketch project.";
+        return false;
+    }
+    const uchar* map = file.map(0, fileSize);
+    if (!map) {
+        error = file.errorString();
+        return false;
+    }
+
+    QDataStream in(QByteArray::fromRawData(reinterpret_cast<const char*>(map), HeaderSize));
+    in.setByteOrder(QDataStream::LittleEndian);
+    quint32 magic, version;
+    Header header;
+    in >> magic >> version >> header.width >> header.height >> header.tileSize >> header.layerCount
+       >> header.directoryOffset >> header.metadataOffset >> header.metadataSize;
+    if (magic != Magic || version != Version || header.tileSize != quint32(LayerStack::TileSize)) {
+        error = "Not a supported BitSketch project.";
+        return false;
+    }
+    if (header.width == 0 || header.height == 0 || header.layerCount == 0) {
+        error = "Project has no pixels.";
+        return false;
+    }
+
+    const int tileCount = LayerStack::tileCount(header.width, header.height);
+    const quint64 directoryBytes = quint64(header.layerCount) * tileCount * EntrySize;
+    if (header.directoryOffset + directoryBytes > quint64(fileSize)
+        || header.metadataOffset + header.metadataSize > quint64(fileSize)) {
+        error = "Project file is truncated.";
+        return false;
+    }
+
+    QVector<TileEntry> entries(header.layerCount * tileCount);
+    QDataStream dir(QByteArray::fromRawData(reinterpret_cast<const char*>(map + header.directoryOffset), directoryBytes));
+    dir.setByteOrder(QDataStream::LittleEndian);
+    for (TileEntry& entry : entries) {
+        dir >> entry.offset >> entry.size >> entry.capacity >> entry.encoding >> entry.fill;
+    }
+
+    QByteArray metadata = qUncompress(map + header.metadataOffset, header.metadataSize);
+    QDataStream meta(metadata);
+    meta.setVersion(QDataStream::Qt_5_0);
+    qint32 pixelSize, storage, currentFrame, frameCount;
+    meta >> pixelSize >> state.selectedColor >> state.palette >> storage >> state.indexPalette
+         >> currentFrame >> frameCount;
+    if (metadata.isEmpty() || frameCount <= 0 || currentFrame < 0 || currentFrame >= frameCount
+        || storage < 0 || storage > qint32(PixelStorage::Indexed8)) {
+        error = "Project metadata is corrupted.";
+        return false;
+    }
+    state.width = header.width;
+    state.height = header.height;
+    state.pixelSize = qMax(1, int(pixelSize));
+    state.currentFrame = currentFrame;
+    state.storage = static_cast<PixelStorage>(storage);
+    const QImage::Format format = LayerStack::layerFormat(state.storage);
+
+    state.frames = QVector<Frame>(frameCount);
+    quint32 slotCount = 0;
+    for (Frame& frame : state.frames) {
+        qint32 currentLayer, layerCount;
+        meta >> currentLayer >> layerCount;
+        if (meta.status() != QDataStream::Ok || layerCount <= 0) {
+            error = "Project metadata is corrupted.";
+            return false;
+        }
+        frame.layers = QVector<Layer>(layerCount);
+        frame.currentLayer = qBound(0, int(currentLayer), layerCount - 1);
+        for (Layer& layer : frame.layers) {
+            readLayerInfo(meta, layer);
+        }
+        slotCount += layerCount;
+    }
+    if (slotCount != header.layerCount) {
+        error = "Project metadata does not match its tiles.";
+        return false;
+    }
+
+    // Entries pointing at the same slot decode to one shared tile image; solid
+    // entries stay solid and allocate nothing.
+    QHash<quint64, QImage> decodedSlots;
+    int slot = 0;
+    for (Frame& frame : state.frames) {
+        for (Layer& layer : frame.layers) {
+            layer.image = emptyLayerImage(state);
+            for (int t = 0; t < tileCount; ++t) {
+                const TileEntry& entry = entries[slot * tileCount + t];
+                const QRect rect = LayerStack::tileRect(t, state.width, state.height);
+                const int rawSize = packedSize(rect, format);
+
+                if (entry.encoding == SolidTile) {
+                    layer.image.setSolid(t, entry.fill);
+                    continue;
+                }
+                if (decodedSlots.contains(entry.offset)) {
+                    layer.image.setTile(t, decodedSlots.value(entry.offset));
+                    continue;
+                }
+                if (entry.offset + entry.size > quint64(fileSize)) {
+                    error = "Project file is truncated.";
+                    return false;
+                }
+
+                QImage tile;
+                const uchar* payload = map + entry.offset;
+                if (entry.encoding == RawTile && int(entry.size) == rawSize) {
+                    tile = unpackTile(reinterpret_cast<const char*>(payload), rect.size(), format);
+                } else if (entry.encoding == ZlibTile) {
+                    QByteArray raw = qUncompress(payload, entry.size);
+                    if (raw.size() != rawSize) {
+                        error = "Project tile is corrupted.";
+                        return false;
+                    }
+                    tile = unpackTile(raw.constData(), rect.size(), format);
+                } else {
+                    error = "Project tile is corrupted.";
+                    return false;
+                }
+                decodedSlots.insert(entry.offset, tile);
+                layer.image.setTile(t, tile);
+            }
+            ++slot;
+        }
+    }
+
+    FrameStore frames;
+    frames.setFrames(state.width, state.height, state.frames);
+    state.layers = frames.expandFrame(state.currentFrame);
+    state.currentLayer = state.frames[state.currentFrame].currentLayer;
+
+    // Chunks are diffed against their successor, so they decode newest first.
+    qint32 chunkCount;
+    meta >> chunkCount;
+    if (meta.status() != QDataStream::Ok || chunkCount < 0) {
+        error = "Project metadata is corrupted.";
+        return false;
+    }
+    QVector<HistoryChunk> history(chunkCount);
+    for (HistoryChunk& chunk : history) {
+        meta >> chunk.offset >> chunk.size;
+    }
+    QVector<Layer> successor = state.layers;
+    for (int k = chunkCount - 1; k >= 0 && meta.status() == QDataStream::Ok; --k) {
+        HistoryChunk& chunk = history[k];
+        if (chunk.offset + chunk.size > quint64(fileSize)) {
+            error = "Project file is truncated.";
+            return false;
+        }
+        QDataStream in(QByteArray::fromRawData(reinterpret_cast<const char*>(map + chunk.offset), chunk.size));
+        in.setVersion(QDataStream::Qt_5_0);
+        chunk.successor = successor;
+        if (!readSnapshot(in, state, successor, chunk.snapshot)) {
+            error = "Project history is corrupted.";
+            return false;
+        }
+        successor = chunk.snapshot;
+    }
+    state.history.clear();
+    for (const HistoryChunk& chunk : history) {
+        state.history.append(chunk.snapshot);
+    }
+    if (meta.status() != QDataStream::Ok) {
+        error = "Project metadata is corrupted.";
+        return false;
+    }
+
+    quint64 live = HeaderSize + directoryBytes + header.metadataSize;
+    QSet<quint64> slotOffsets;
+    for (const TileEntry& entry : entries) {
+        if (entry.capacity > 0 && !slotOffsets.contains(entry.offset)) {
+            slotOffsets.insert(entry.offset);
+            live += entry.capacity;
+        }
+    }
+    for (const HistoryChunk& chunk : history) {
+        live += chunk.size;
+    }
+    deadBytes = quint64(fileSize) - qMin(live, quint64(fileSize));
+
+    directory = entries;
+    savedHistory = history;
+    metadataSize = header.metadataSize;
+    remember(path, state, collectSlots(state));
+    return true;
+}
@@ -0,0 +1,88 @@
+#ifndef PROJECTFILE_H
+#define PROJECTFILE_H
+
+#include <QColor>
+#include <QDateTime>
+#include <QString>
+#include <QVector>
+#include "layerstack.h"
+#include "framestore.h"
+
+struct ProjectState {
+    int width;
+    int height;
+    QVector<Layer> layers; // the frame being edited
+    int currentLayer;
+    QVector<Frame> frames; // all frames; frames[currentFrame] is superseded by layers
+    int currentFrame;
+    int pixelSize;
+    QColor selectedColor;
+    QVector<QRgb> palette;
+    PixelStorage storage;
+    QVector<QRgb> indexPalette; // colour table of Indexed8 layers
+    QVector<QVector<Layer>> history;
+};
+
+// Native .bsk project file:
+//   header (64 bytes) | tile data | history chunks | tile directory | metadata
+// Every layer of every frame is stored as its LayerStack::TileSize tiles,
+// raw, zlib compressed or as a single fill value; identical tiles share one
+// slot. Tile bytes are packed rows in the layers' pixel storage format; raw
+// tiles are copied straight out of the memory-mapped file on load. Undo
+// history is kept in one chunk per snapshot, listed by the metadata.
+//
+// Saving again to the same path only appends what changed since the previous
+// load/save: new tiles, new history chunks, then a fresh directory and
+// metadata. Nothing the current header points at is overwritten, and the
+// header is rewritten last, after the appended data has been synced, so a
+// crash mid-save leaves the previous save intact. Once more than
+// MaxDeadPercent of the file is superseded data, the next save rewrites the
+// whole file instead.
+class ProjectFile {
+public:
+    static const int MaxSavedHistory = 32;
+    static const int MaxDeadPercent = 50;
+
+    ProjectFile();
+
+    bool save(const QString& path, const ProjectState& state);
+    bool load(const QString& path, ProjectState& state);
+    QString errorString() const { return error; }
+
+    struct TileEntry {
+        quint64 offset;
+        quint32 size;
+        quint32 capacity;
+        quint32 encoding;
+        quint32 fill;
+    };
+
+    struct HistoryChunk {
+        quint64 offset;
+        quint32 size;
+        QVector<Layer> snapshot;  // as saved, to recognise it on the next save
+        QVector<Layer> successor; // the layers the chunk is diffed against
+    };
+
+private:
+    bool writeFull(const QString& path, const ProjectState& state, const QVector<TiledImage>& layerSlots);
+    bool writeIncremental(const QString& path, const ProjectState& state, const QVector<TiledImage>& layerSlots);
+    bool canWriteIncremental(const QString& path, const ProjectState& state,
+                             const QVector<TiledImage>& layerSlots) const;
+    QVector<HistoryChunk> appendHistory(QIODevice* device, const ProjectState& state, quint64& end, bool reuse) const;
+    void remember(const QString& path, const ProjectState& state, const QVector<TiledImage>& layerSlots);
+
+    QString error;
+    QString lastPath;
+    QDateTime lastModified;
+    int savedWidth;
+    int savedHeight;
+    PixelStorage savedStorage;
+    QVector<TiledImage> savedSlots;
+    QVector<TileEntry> directory;
+    QVector<HistoryChunk> savedHistory;
+    quint32 metadataSize;
+    quint64 deadBytes;
+};
+
+#endif // PROJECTFILE_H
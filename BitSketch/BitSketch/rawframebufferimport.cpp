@@ -0,0 +1,51 @@
+#include "rawframebufferimport.h"
+#include "trace.h"
+#include <QFile>
+#include <QScopedPointer>
+#include <climits>
+
+namespace {
+
+// QImage cleanup function; closing the file drops the mapping.
+void closeMappedFile(void* file) {
+    delete static_cast<QFile*>(file);
+}
+
+} // namespace
+
+bool RawFramebufferImport::load(const QString& path, int width, PixelFormat format, int stride) {
+    TRACE_SCOPE("RawFramebufferImport::load");
+    error.clear();
+    mapped = QImage();
+
+    const qint64 minStride = qint64(width) * pixelFormatBytes(format);
+    const qint64 rowBytes = stride > 0 ? stride : minStride;
+    if (width <= 0 || rowBytes < minStride || rowBytes > INT_MAX) {
+        error = "Invalid width or stride.";
+        return false;
+    }
+
+    QScopedPointer<QFile> file(new QFile(path));
+    if (!file->open(QIODevice::ReadOnly)) {
+        error = file->errorString();
+        return false;
+    }
+    const qint64 height = file->size() / rowBytes;
+    if (height == 0) {
+        error = "The file is smaller than one row.";
+        return false;
+    }
+    // QImage addresses its pixels with int offsets.
+    if (height * rowBytes > INT_MAX) {
+        error = "The framebuffer is larger than 2 GB.";
+        return false;
+    }
+
+    const uchar* data = file->map(0, height * rowBytes);
+    if (!data) {
+        error = file->errorString();
+        return false;
+    }
+    mapped = QImage(data, width, int(height), int(rowBytes), pixelFormatToImageFormat(format), closeMappedFile, file.take());
+    return true;
+}
@@ -0,0 +1,25 @@
+#ifndef RAWFRAMEBUFFERIMPORT_H
+#define RAWFRAMEBUFFERIMPORT_H
+
+#include <QImage>
+#include <QString>
+#include "pixelbuffer.h"
+
+// Opens raw framebuffer dumps (.bin): headerless rows of packed pixels whose
+// width and format the caller knows. The file is memory-mapped and image()
+// is a read-only view of the mapping, so nothing is read or converted until
+// pixels are used; the mapping stays alive as long as any copy of the image.
+// Rows are width * bytes per pixel long unless a stride is given, and a
+// partial row at the end of the file is ignored.
+class RawFramebufferImport {
+public:
+    bool load(const QString& path, int width, PixelFormat format, int stride = 0);
+    QString errorString() const { return error; }
+    QImage image() const { return mapped; }
+
+private:
+    QString error;
+    QImage mapped;
+};
+
+#endif // RAWFRAMEBUFFERIMPORT_H
@@ -0,0 +1,53 @@
+#ifndef RGB565_H
+#define RGB565_H
+
+#include <QByteArray>
+#include <QColor>
+#include <QVector>
+
+inline quint16 toRgb565(QRgb color) {
+    return ((qRed(color) & 0xF8) << 8) | ((qGreen(color) & 0xFC) << 3) | (qBlue(color) >> 3);
+}
+
+// Expands to 8 bits per channel by replicating the top bits, so 0xFFFF is
+// white and 0x0000 black.
+inline QRgb fromRgb565(quint16 value) {
+    const int r = (value >> 11) & 0x1F;
+    const int g = (value >> 5) & 0x3F;
+    const int b = value & 0x1F;
+    return qRgb((r << 3) | (r >> 2), (g << 2) | (g >> 4), (b << 3) | (b >> 2));
+}
+
+// fromRgb565() for every value, for converting whole buffers.
+inline const QRgb* rgb565Lut() {
+    static const QVector<QRgb> table = [] {
+        QVector<QRgb> entries(65536);
+        for (int value = 0; value < entries.size(); ++value) {
+            entries[value] = fromRgb565(quint16(value));
+        }
+        return entries;
+    }();
+    return table.constData();
+}
+
+// Appends "0xXXXX, 0xXXXX, ...,\n" without going through QString::arg, which
+// dominates export time on large images.
+inline void appendHexRow(QByteArray& out, const quint16* values, int count) {
+    static const char digits[] = "0123456789abcdef";
+    const int start = out.size();
+    out.resize(start + count * 8);
+    char* p = out.data() + start;
+    for (int i = 0; i < count; ++i) {
+        const quint16 v = values[i];
+        *p++ = '0';
+        *p++ = 'x';
+        *p++ = digits[v >> 12];
+        *p++ = digits[(v >> 8) & 0xF];
+        *p++ = digits[(v >> 4) & 0xF];
+        *p++ = digits[v & 0xF];
+        *p++ = ',';
+        *p++ = i + 1 < count ? ' ' : '\n';
+    }
+}
+
+#endif // RGB565_H
@@ -0,0 +1,69 @@
+#include "savequeue.h"
+#include "trace.h"
+#include <algorithm>
+
+SaveQueue::SaveQueue(QObject* parent)
+    : QThread(parent), busy(false), stopping(false) {}
+
+// Saves still queued are written before the queue goes away.
+SaveQueue::~SaveQueue() {
+    {
+        QMutexLocker locker(&mutex);
+        stopping = true;
+        wakeup.wakeOne();
+    }
+    wait();
+}
+
+void SaveQueue::enqueue(const QString& path, const QString& doneMessage, Writer writer) {
+    QMutexLocker locker(&mutex);
+    Job job{path, doneMessage, writer};
+    auto it = std::find_if(queue.begin(), queue.end(), [&](const Job& queued) { return queued.path == path; });
+    if (it != queue.end()) {
+        *it = job;
+    } else {
+        queue.append(job);
+    }
+    if (!isRunning()) start(QThread::LowPriority);
+    wakeup.wakeOne();
+}
+
+// For callers that are about to touch what a queued writer uses, such as
+// loading through the ProjectFile a project save writes with.
+void SaveQueue::waitForIdle() {
+    QMutexLocker locker(&mutex);
+    while (busy || !queue.isEmpty()) {
+        idle.wait(&mutex);
+    }
+}
+
+void SaveQueue::run() {
+    forever {
+        Job job;
+        {
+            QMutexLocker locker(&mutex);
+            while (queue.isEmpty() && !stopping) {
+                wakeup.wait(&mutex);
+            }
+            if (queue.isEmpty()) break;
+            job = queue.takeFirst();
+            busy = true;
+        }
+
+        QString error;
+        bool ok;
+        {
+            TRACE_SCOPE("SaveQueue::write");
+            ok = job.writer(error);
+        }
+        if (ok) {
+            emit saved(job.doneMessage);
+        } else {
+            emit failed(job.path, error);
+        }
+
+        QMutexLocker locker(&mutex);
+        busy = false;
+        if (queue.isEmpty()) idle.wakeAll();
+    }
+}
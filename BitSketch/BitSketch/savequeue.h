@@ -0,0 +1,53 @@
+#ifndef SAVEQUEUE_H
+#define SAVEQUEUE_H
+
+#include <QMutex>
+#include <QString>
+#include <QThread>
+#include <QVector>
+#include <QWaitCondition>
+#include <functional>
+
+// Background writer for document saves. The GUI thread queues a target path
+// and a function that writes a snapshot of the document there. Snapshots are
+// captured by value and rely on implicit sharing (tiles, layers, QImage), so
+// queueing costs no pixel copies and editing continues while the file is
+// written. A job queued for a path that already has one waiting replaces it,
+// so repeated saves of the same document collapse into the newest state.
+// Outcomes are reported through saved()/failed(), delivered to receivers on
+// their own threads.
+class SaveQueue : public QThread {
+    Q_OBJECT
+
+public:
+    typedef std::function<bool(QString& error)> Writer;
+
+    explicit SaveQueue(QObject* parent = nullptr);
+    ~SaveQueue();
+
+    void enqueue(const QString& path, const QString& doneMessage, Writer writer);
+    void waitForIdle();
+
+signals:
+    void saved(const QString& message);
+    void failed(const QString& path, const QString& error);
+
+protected:
+    void run() override;
+
+private:
+    struct Job {
+        QString path;
+        QString doneMessage;
+        Writer writer;
+    };
+
+    QMutex mutex;
+    QWaitCondition wakeup;
+    QWaitCondition idle;
+    QVector<Job> queue;
+    bool busy;
+    bool stopping;
+};
+
+#endif // SAVEQUEUE_H
@@ -0,0 +1,125 @@
+#include "stallwatchdog.h"
+#include "trace.h"
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QStandardPaths>
+#include <QTextStream>
+
+namespace {
+
+const int DefaultThresholdMs = 500;
+const qint64 BucketLimitsMs[] = {500, 1000, 2000, 5000};
+const char* const BucketNames[] = {"< 0.5 s", "0.5-1 s", "1-2 s", "2-5 s", ">= 5 s"};
+const int BucketCount = 5;
+
+} // namespace
+
+StallWatchdog::StallWatchdog(QObject* parent)
+    : QThread(parent), threshold(0), heartbeat(0), stopping(false), buckets(BucketCount, 0) {
+    connect(&heartbeatTimer, &QTimer::timeout, this, [this] { heartbeat.store(clock.elapsed()); });
+}
+
+StallWatchdog::~StallWatchdog() {
+    stopWatching();
+}
+
+int StallWatchdog::thresholdFromEnvironment() {
+    bool ok = false;
+    const int value = qEnvironmentVariableIntValue("BITSKETCH_STALL_MS", &ok);
+    return ok ? value : DefaultThresholdMs;
+}
+
+void StallWatchdog::startWatching(int thresholdMs) {
+    if (thresholdMs <= 0 || isRunning()) return;
+    threshold = thresholdMs;
+    clock.start();
+    heartbeat.store(0);
+    heartbeatTimer.start(qMax(10, threshold / 5));
+    Trace::setTrackOperations(true);
+    stopping = false;
+    start(QThread::LowPriority);
+}
+
+void StallWatchdog::stopWatching() {
+    if (!isRunning()) return;
+    {
+        QMutexLocker locker(&mutex);
+        stopping = true;
+        wakeup.wakeOne();
+    }
+    wait();
+    heartbeatTimer.stop();
+    Trace::setTrackOperations(false);
+
+    const QString text = report();
+    if (text.isEmpty()) return;
+    qInfo().noquote() << text;
+    const QString dir = QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation);
+    QDir().mkpath(dir);
+    QFile file(dir + "/stall-report.txt");
+    if (file.open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Text)) {
+        QTextStream(&file) << QDateTime::currentDateTime().toString(Qt::ISODate) << "\n" << text << "\n";
+    }
+}
+
+void StallWatchdog::run() {
+    const int pollMs = qMax(10, threshold / 4);
+    bool stalled = false;
+    qint64 stallBeat = 0;
+    QString stallOperation;
+
+    QMutexLocker locker(&mutex);
+    while (!stopping) {
+        wakeup.wait(&mutex, pollMs);
+        const qint64 beat = heartbeat.load();
+        const qint64 now = clock.elapsed();
+
+        if (!stalled && now - beat >= threshold) {
+            stalled = true;
+            stallBeat = beat;
+            const char* operation = Trace::currentOperation();
+            stallOperation = operation ? QString::fromLatin1(operation) : QString("(no instrumented operation)");
+            qWarning().noquote() << QString("GUI thread not responding for %1 ms in %2").arg(now - beat).arg(stallOperation);
+        } else if (stalled && beat != stallBeat) {
+            stalled = false;
+            recordStall(beat - stallBeat, stallOperation);
+        } else if (stalled && stallOperation.startsWith('(')) {
+            // The stall may have been caught before the operation's scope opened.
+            if (const char* operation = Trace::currentOperation()) stallOperation = QString::fromLatin1(operation);
+        }
+    }
+    if (stalled) {
+        recordStall(clock.elapsed() - stallBeat, stallOperation);
+    }
+}
+
+// Called on the watchdog thread with mutex held.
+void StallWatchdog::recordStall(qint64 durationMs, const QString& operation) {
+    qWarning().noquote() << QString("GUI thread stalled for %1 ms in %2").arg(durationMs).arg(operation);
+    int bucket = 0;
+    while (bucket < BucketCount - 1 && durationMs >= BucketLimitsMs[bucket]) ++bucket;
+    ++buckets[bucket];
+    stallTime[operation] += durationMs;
+    ++stallCount[operation];
+}
+
+QString StallWatchdog::report() const {
+    int total = 0;
+    for (int count : buckets) total += count;
+    if (total == 0) return QString();
+
+    QString text;
+    QTextStream out(&text);
+    out << "GUI stalls this session (threshold " << threshold << " ms): " << total << "\n";
+    for (int i = 0; i < BucketCount; ++i) {
+        if (buckets[i] == 0) continue;
+        out << QString("  %1 %2 %3\n").arg(BucketNames[i], -8).arg(buckets[i], 4).arg(QString(qMin(buckets[i], 40), '#'));
+    }
+    out << "By operation:\n";
+    for (auto it = stallTime.constBegin(); it != stallTime.constEnd(); ++it) {
+        out << QString("  %1: %2 stalls, %3 ms\n").arg(it.key()).arg(stallCount.value(it.key())).arg(it.value());
+    }
+    return text.trimmed();
+}
@@ -0,0 +1,52 @@
+#ifndef STALLWATCHDOG_H
+#define STALLWATCHDOG_H
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QMutex>
+#include <QThread>
+#include <QTimer>
+#include <QVector>
+#include <QWaitCondition>
+#include <atomic>
+
+// Detects GUI event loop stalls. A timer on the GUI thread stamps a
+// heartbeat; a low-priority thread checks it and, once it is older than the
+// threshold, logs the stall together with the instrumented operation
+// (TRACE_SCOPE) the GUI thread is in. The stall is measured when the
+// heartbeat resumes. stop() prints a histogram of the session's stalls and
+// appends it to stall-report.txt in the application data directory.
+//
+// BITSKETCH_STALL_MS sets the threshold (default 500 ms, 0 disables).
+class StallWatchdog : public QThread {
+    Q_OBJECT
+
+public:
+    explicit StallWatchdog(QObject* parent = nullptr);
+    ~StallWatchdog();
+
+    static int thresholdFromEnvironment();
+
+    void startWatching(int thresholdMs);
+    void stopWatching();
+
+protected:
+    void run() override;
+
+private:
+    void recordStall(qint64 durationMs, const QString& operation);
+    QString report() const;
+
+    int threshold;
+    QTimer heartbeatTimer;
+    QElapsedTimer clock;
+    std::atomic<qint64> heartbeat;
+    QMutex mutex;
+    QWaitCondition wakeup;
+    bool stopping;
+    QVector<int> buckets;             // stalls per histogram bucket
+    QHash<QString, qint64> stallTime; // total stall time per operation
+    QHash<QString, int> stallCount;
+};
+
+#endif // STALLWATCHDOG_H
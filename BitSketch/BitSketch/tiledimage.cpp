@@ -0,0 +1,254 @@
+#include "tiledimage.h"
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+inline uint loadPixel(const uchar* p, int bytes) {
+    switch (bytes) {
+    case 1: return *p;
+    case 2: return *reinterpret_cast<const quint16*>(p);
+    default: return *reinterpret_cast<const quint32*>(p);
+    }
+}
+
+void fillPixels(uchar* p, int count, uint value, int bytes) {
+    switch (bytes) {
+    case 1:
+        memset(p, int(value), count);
+        break;
+    case 2: {
+        quint16* line = reinterpret_cast<quint16*>(p);
+        std::fill(line, line + count, quint16(value));
+        break;
+    }
+    default: {
+        quint32* line = reinterpret_cast<quint32*>(p);
+        std::fill(line, line + count, quint32(value));
+        break;
+    }
+    }
+}
+
+bool allPixelsEqual(const uchar* p, int count, uint value, int bytes) {
+    for (int i = 0; i < count; ++i) {
+        if (loadPixel(p + i * bytes, bytes) != value) return false;
+    }
+    return true;
+}
+
+} // namespace
+
+TiledImage::TiledImage()
+    : imageWidth(0), imageHeight(0), columns(0), pixelBytes(4), imageFormat(QImage::Format_ARGB32_Premultiplied) {}
+
+TiledImage::TiledImage(int width, int height, QImage::Format format, uint fill)
+    : imageWidth(qMax(0, width)), imageHeight(qMax(0, height)),
+      columns((imageWidth + TileSize - 1) / TileSize), pixelBytes(QImage::toPixelFormat(format).bitsPerPixel() / 8),
+      imageFormat(format) {
+    const int count = tileCount(imageWidth, imageHeight);
+    tiles = QVector<QImage>(count);
+    fills = QVector<uint>(count, fill);
+}
+
+// Only for 32-bit formats. Pixels outside the source image are transparent;
+// tiles that come out a single colour are kept solid.
+TiledImage TiledImage::fromImage(const QImage& image, int width, int height, QImage::Format format) {
+    TiledImage result(width, height, format, 0);
+    const QImage source = image.convertToFormat(format);
+    for (int t = 0; t < result.tileCount(); ++t) {
+        const QRect rect = result.tileRect(t);
+        QImage tile(rect.size(), format);
+        tile.fill(0);
+        const QRect inside = rect & source.rect();
+        for (int y = 0; y < inside.height(); ++y) {
+            const QRgb* line = reinterpret_cast<const QRgb*>(source.constScanLine(inside.top() + y)) + inside.left();
+            QRgb* dst = reinterpret_cast<QRgb*>(tile.scanLine(inside.top() - rect.top() + y)) + inside.left() - rect.left();
+            memcpy(dst, line, inside.width() * sizeof(QRgb));
+        }
+        result.tiles[t] = tile;
+        result.squeezeTile(t);
+    }
+    return result;
+}
+
+// Row padding is zeroed so equal tiles compare and hash equal byte for byte.
+QImage TiledImage::newTile(int index) const {
+    const QRect rect = tileRect(index);
+    QImage image(rect.size(), imageFormat);
+    memset(image.bits(), 0, image.sizeInBytes());
+    for (int y = 0; y < rect.height(); ++y) {
+        fillPixels(image.scanLine(y), rect.width(), fills[index], pixelBytes);
+    }
+    return image;
+}
+
+QImage TiledImage::tileImage(int index) const {
+    return tiles[index].isNull() ? newTile(index) : tiles[index];
+}
+
+void TiledImage::setTile(int index, const QImage& image) {
+    tiles[index] = image.format() == imageFormat ? image : image.convertToFormat(imageFormat);
+}
+
+void TiledImage::setSolid(int index, uint fill) {
+    tiles[index] = QImage();
+    fills[index] = fill;
+}
+
+// Drops the pixels of an allocated tile that holds a single value.
+bool TiledImage::squeezeTile(int index) {
+    uint value;
+    if (tiles[index].isNull()) return true;
+    if (!isUniform(tiles[index], &value)) return false;
+    setSolid(index, value);
+    return true;
+}
+
+const uchar* TiledImage::constScanLine(int index, int row) const {
+    const QImage& image = tiles[index];
+    return image.isNull() ? nullptr : image.constScanLine(row);
+}
+
+uchar* TiledImage::scanLine(int index, int row) {
+    QImage& image = tiles[index];
+    if (image.isNull()) image = newTile(index);
+    return image.scanLine(row);
+}
+
+uint TiledImage::pixel(int x, int y) const {
+    const int index = tileIndex(x, y);
+    const uchar* line = constScanLine(index, y % TileSize);
+    return line ? loadPixel(line + (x % TileSize) * pixelBytes, pixelBytes) : fills[index];
+}
+
+// Writing a tile's own fill value into a solid tile leaves it unallocated.
+void TiledImage::setPixel(int x, int y, uint value) {
+    const int index = tileIndex(x, y);
+    if (isSolid(index) && fills[index] == value) return;
+    fillPixels(scanLine(index, y % TileSize) + (x % TileSize) * pixelBytes, 1, value, pixelBytes);
+}
+
+void TiledImage::readLine(int x, int y, int count, void* out) const {
+    uchar* dst = static_cast<uchar*>(out);
+    const int row = y % TileSize;
+    while (count > 0) {
+        const int index = tileIndex(x, y);
+        const int offset = x % TileSize;
+        const int span = qMin(count, tileRect(index).width() - offset);
+        const uchar* line = constScanLine(index, row);
+        if (line) {
+            memcpy(dst, line + offset * pixelBytes, span * pixelBytes);
+        } else {
+            fillPixels(dst, span, fills[index], pixelBytes);
+        }
+        dst += span * pixelBytes;
+        x += span;
+        count -= span;
+    }
+}
+
+void TiledImage::writeLine(int x, int y, int count, const void* in) {
+    const uchar* src = static_cast<const uchar*>(in);
+    const int row = y % TileSize;
+    while (count > 0) {
+        const int index = tileIndex(x, y);
+        const int offset = x % TileSize;
+        const int span = qMin(count, tileRect(index).width() - offset);
+        if (!isSolid(index) || !allPixelsEqual(src, span, fills[index], pixelBytes)) {
+            memcpy(scanLine(index, row) + offset * pixelBytes, src, span * pixelBytes);
+        }
+        src += span * pixelBytes;
+        x += span;
+        count -= span;
+    }
+}
+
+// Tiles the rectangle covers completely become solid and drop their pixels.
+void TiledImage::fill(const QRect& rect, uint value) {
+    const QRect bounded = rect & this->rect();
+    if (bounded.isEmpty()) return;
+
+    for (int ty = bounded.top() / TileSize; ty <= bounded.bottom() / TileSize; ++ty) {
+        for (int tx = bounded.left() / TileSize; tx <= bounded.right() / TileSize; ++tx) {
+            const int index = ty * columns + tx;
+            const QRect tile = tileRect(index);
+            const QRect part = bounded & tile;
+            if (part == tile) {
+                setSolid(index, value);
+                continue;
+            }
+            if (isSolid(index) && fills[index] == value) continue;
+            for (int y = part.top(); y <= part.bottom(); ++y) {
+                uchar* line = scanLine(index, y - tile.top()) + (part.left() - tile.left()) * pixelBytes;
+                fillPixels(line, part.width(), value, pixelBytes);
+            }
+        }
+    }
+}
+
+QImage TiledImage::copy(const QRect& rect) const {
+    const QRect bounded = rect & this->rect();
+    if (bounded.isEmpty()) return QImage();
+
+    QImage block(bounded.size(), imageFormat);
+    if (imageFormat == QImage::Format_Indexed8) block.setColorTable(colors);
+    for (int y = 0; y < bounded.height(); ++y) {
+        readLine(bounded.left(), bounded.top() + y, bounded.width(), block.scanLine(y));
+    }
+    return block;
+}
+
+QImage TiledImage::toImage() const {
+    return copy(rect());
+}
+
+// Nearest-neighbour sample that fits inside size, for list thumbnails; only
+// the sampled pixels are read.
+QImage TiledImage::thumbnail(const QSize& size) const {
+    if (isNull()) return QImage();
+    const QSize target = this->size().scaled(size, Qt::KeepAspectRatio).expandedTo(QSize(1, 1));
+    QImage image(target, imageFormat);
+    if (imageFormat == QImage::Format_Indexed8) image.setColorTable(colors);
+    for (int y = 0; y < target.height(); ++y) {
+        const int sy = y * imageHeight / target.height();
+        uchar* line = image.scanLine(y);
+        for (int x = 0; x < target.width(); ++x) {
+            fillPixels(line + x * pixelBytes, 1, pixel(x * imageWidth / target.width(), sy), pixelBytes);
+        }
+    }
+    return image;
+}
+
+int TiledImage::allocatedTiles() const {
+    return std::count_if(tiles.begin(), tiles.end(), [](const QImage& tile) { return !tile.isNull(); });
+}
+
+qint64 TiledImage::allocatedBytes() const {
+    qint64 bytes = 0;
+    for (const QImage& tile : tiles) {
+        bytes += tile.sizeInBytes();
+    }
+    return bytes;
+}
+
+int TiledImage::tileCount(int width, int height) {
+    return ((width + TileSize - 1) / TileSize) * ((height + TileSize - 1) / TileSize);
+}
+
+bool TiledImage::isUniform(const QImage& tile, uint* value) {
+    const int bytes = tile.depth() / 8;
+    const uint first = loadPixel(tile.constScanLine(0), bytes);
+    for (int y = 0; y < tile.height(); ++y) {
+        if (!allPixelsEqual(tile.constScanLine(y), tile.width(), first, bytes)) return false;
+    }
+    *value = first;
+    return true;
+}
+
+// Tiles are numbered row-major; edge tiles are clipped to the image.
+QRect TiledImage::tileRect(int index, int width, int height) {
+    const int tilesPerRow = (width + TileSize - 1) / TileSize;
+    QRect rect((index % tilesPerRow) * TileSize, (index / tilesPerRow) * TileSize, TileSize, TileSize);
+    return rect & QRect(0, 0, width, height);
+}
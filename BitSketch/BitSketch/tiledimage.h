@@ -0,0 +1,84 @@
+#ifndef TILEDIMAGE_H
+#define TILEDIMAGE_H
+
+#include <QImage>
+#include <QRect>
+#include <QSize>
+#include <QVector>
+
+// An image kept as TileSize x TileSize tiles. A tile nobody has written to
+// holds no pixels, only a fill value, so a large canvas costs memory in
+// proportion to what has been drawn on it. Tiles are implicitly shared
+// QImages: copying a TiledImage is cheap and a write detaches only the tile
+// it lands in.
+//
+// Pixels are raw values of the image format (Format_ARGB32_Premultiplied,
+// Format_RGB32, Format_RGB16 or Format_Indexed8); interpreting them is up to
+// the owner. Indexed images carry their colour table for toImage().
+class TiledImage {
+public:
+    static const int TileSize = 64;
+
+    TiledImage();
+    TiledImage(int width, int height, QImage::Format format, uint fill);
+    static TiledImage fromImage(const QImage& image, int width, int height, QImage::Format format);
+
+    bool isNull() const { return imageWidth == 0 || imageHeight == 0; }
+    int width() const { return imageWidth; }
+    int height() const { return imageHeight; }
+    QSize size() const { return QSize(imageWidth, imageHeight); }
+    QRect rect() const { return QRect(0, 0, imageWidth, imageHeight); }
+    QImage::Format format() const { return imageFormat; }
+    int bytesPerPixel() const { return pixelBytes; }
+    QVector<QRgb> colorTable() const { return colors; }
+    void setColorTable(const QVector<QRgb>& table) { colors = table; }
+
+    int tileColumns() const { return columns; }
+    int tileCount() const { return tiles.size(); }
+    int tileIndex(int x, int y) const { return (y / TileSize) * columns + x / TileSize; }
+    QRect tileRect(int index) const { return tileRect(index, imageWidth, imageHeight); }
+
+    bool isSolid(int index) const { return tiles[index].isNull(); }
+    uint fillValue(int index) const { return fills[index]; }
+    const QImage& tile(int index) const { return tiles[index]; }
+    QImage tileImage(int index) const;
+    void setTile(int index, const QImage& image);
+    void setSolid(int index, uint fill);
+    bool squeezeTile(int index);
+
+    // Rows inside one tile; constScanLine() is null for a solid tile and
+    // scanLine() allocates it.
+    const uchar* constScanLine(int index, int row) const;
+    uchar* scanLine(int index, int row);
+
+    uint pixel(int x, int y) const;
+    void setPixel(int x, int y, uint value);
+    void readLine(int x, int y, int count, void* out) const;
+    void writeLine(int x, int y, int count, const void* in);
+    void fill(const QRect& rect, uint value);
+
+    QImage copy(const QRect& rect) const;
+    QImage toImage() const;
+    QImage thumbnail(const QSize& size) const;
+
+    int allocatedTiles() const;
+    qint64 allocatedBytes() const;
+
+    static int tileCount(int width, int height);
+    static QRect tileRect(int index, int width, int height);
+    static bool isUniform(const QImage& tile, uint* value);
+
+private:
+    QImage newTile(int index) const;
+
+    int imageWidth;
+    int imageHeight;
+    int columns;
+    int pixelBytes;
+    QImage::Format imageFormat;
+    QVector<QImage> tiles; // null while the tile is solid
+    QVector<uint> fills;
+    QVector<QRgb> colors;
+};
+
+#endif // TILEDIMAGE_H
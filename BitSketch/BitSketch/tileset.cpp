@@ -0,0 +1,151 @@
+#include "tileset.h"
+#include "rgb565.h"
+#include <QFile>
+#include <QMultiHash>
+#include <cstring>
+
+Tileset::Tileset()
+    : size(0), mapColumns(0), mapRows(0), imageWidth(0), imageHeight(0), flips(false) {}
+
+void Tileset::flipTile(const quint16* source, quint16* target, quint16 flags) const {
+    for (int y = 0; y < size; ++y) {
+        const quint16* line = source + ((flags & FlipY) ? size - 1 - y : y) * size;
+        quint16* out = target + y * size;
+        if (flags & FlipX) {
+            for (int x = 0; x < size; ++x) {
+                out[x] = line[size - 1 - x];
+            }
+        } else {
+            memcpy(out, line, size * sizeof(quint16));
+        }
+    }
+}
+
+// True if drawing the unique tile named by entry, flipped as it says,
+// reproduces tile exactly.
+bool Tileset::matches(const quint16* tile, quint16 entry) const {
+    const int tilePixels = size * size;
+    const quint16 flags = flips ? entry & (FlipX | FlipY) : 0;
+    const int index = flips ? entry & IndexMask : entry;
+    const quint16* stored = uniqueTiles.constData() + index * tilePixels;
+    if (!flags) {
+        return memcmp(stored, tile, tilePixels * sizeof(quint16)) == 0;
+    }
+    QVector<quint16> flipped(tilePixels);
+    flipTile(stored, flipped.data(), flags);
+    return memcmp(flipped.constData(), tile, tilePixels * sizeof(quint16)) == 0;
+}
+
+bool Tileset::build(const QImage& image, int tileSize, bool matchFlips) {
+    if (image.isNull() || tileSize <= 0) {
+        error = "No image to split into tiles.";
+        return false;
+    }
+
+    const QImage source = image.convertToFormat(QImage::Format_RGB32);
+    size = tileSize;
+    flips = matchFlips;
+    imageWidth = source.width();
+    imageHeight = source.height();
+    mapColumns = (imageWidth + size - 1) / size;
+    mapRows = (imageHeight + size - 1) / size;
+    uniqueTiles.clear();
+    tileMap.clear();
+    tileMap.reserve(mapColumns * mapRows);
+
+    // Flipped variants of each unique tile are hashed when it is added, so
+    // every incoming tile needs a single hash lookup whether flips are on or not.
+    const int maxTiles = matchFlips ? IndexMask + 1 : 0x10000;
+    const int tilePixels = size * size;
+    QVector<quint16> tile(tilePixels);
+    QVector<quint16> variant(tilePixels);
+    QMultiHash<uint, quint16> lookup;
+
+    for (int row = 0; row < mapRows; ++row) {
+        for (int column = 0; column < mapColumns; ++column) {
+            tile.fill(0);
+            const int left = column * size;
+            const int width = qMin(size, imageWidth - left);
+            for (int y = 0; y < size && row * size + y < imageHeight; ++y) {
+                const QRgb* line = reinterpret_cast<const QRgb*>(source.constScanLine(row * size + y)) + left;
+                quint16* out = tile.data() + y * size;
+                for (int x = 0; x < width; ++x) {
+                    out[x] = toRgb565(line[x]);
+                }
+            }
+
+            const uint hash = qHashBits(tile.constData(), tilePixels * sizeof(quint16));
+            int entry = -1;
+            for (auto it = lookup.constFind(hash); it != lookup.constEnd() && it.key() == hash; ++it) {
+                if (matches(tile.constData(), it.value())) {
+                    entry = it.value();
+                    break;
+                }
+            }
+
+            if (entry < 0) {
+                const int index = tileCount();
+                if (index >= maxTiles) {
+                    error = QString("Image has more than %1 unique tiles.").arg(maxTiles);
+                    return false;
+                }
+                uniqueTiles.append(tile);
+                lookup.insert(hash, quint16(index));
+                if (matchFlips) {
+                    const quint16 variants[] = {FlipX, FlipY, quint16(FlipX | FlipY)};
+                    for (quint16 flags : variants) {
+                        flipTile(tile.constData(), variant.data(), flags);
+                        lookup.insert(qHashBits(variant.constData(), tilePixels * sizeof(quint16)),
+                                      quint16(index | flags));
+                    }
+                }
+                entry = index;
+            }
+            tileMap.append(quint16(entry));
+        }
+    }
+    return true;
+}
+
+QByteArray Tileset::toHex(const QString& prefix) const {
+    const QByteArray p = prefix.toLatin1();
+    const int tilePixels = size * size;
+    QByteArray out;
+    out.reserve(uniqueTiles.size() * 8 + tileMap.size() * 8 + 1024);
+    out += QString("// %1x%2 image, %3x%3 tiles, %4 unique of %5\n")
+               .arg(imageWidth).arg(imageHeight).arg(size).arg(tileCount()).arg(tileMap.size())
+               .toLatin1();
+    out += QString("const uint16_t %1_tile_size = %2;\n").arg(prefix).arg(size).toLatin1();
+    out += QString("const uint16_t %1_tile_count = %2;\n").arg(prefix).arg(tileCount()).toLatin1();
+    out += QString("const uint16_t %1_map_width = %2;\n").arg(prefix).arg(mapColumns).toLatin1();
+    out += QString("const uint16_t %1_map_height = %2;\n").arg(prefix).arg(mapRows).toLatin1();
+    out += "const uint16_t " + p + "_tiles [] PROGMEM = {\n";
+    for (int i = 0; i < tileCount(); ++i) {
+        appendHexRow(out, uniqueTiles.constData() + i * tilePixels, tilePixels);
+    }
+    out += "};\n";
+    if (flips) {
+        out += "// Bits 0-13: tile index, bit 14: flip vertically, bit 15: flip horizontally\n";
+    }
+    out += "const uint16_t " + p + "_tilemap [] PROGMEM = {\n";
+    for (int row = 0; row < mapRows; ++row) {
+        appendHexRow(out, tileMap.constData() + row * mapColumns, mapColumns);
+    }
+    out += "};\n";
+    return out;
+}
+
+bool Tileset::save(const QString& path) const {
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+        error = file.errorString();
+        return false;
+    }
+
+    const QByteArray out = toHex("epd_bitmap");
+    if (file.write(out) != out.size()) {
+        error = file.errorString();
+        return false;
+    }
+    return true;
+}
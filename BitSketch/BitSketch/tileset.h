@@ -0,0 +1,47 @@
+#ifndef TILESET_H
+#define TILESET_H
+
+#include <QImage>
+#include <QString>
+#include <QVector>
+
+// Splits an image into square tiles, converts them to RGB565 and keeps each
+// distinct tile once. The tile map holds one entry per tile position: the
+// index of the unique tile, plus flip bits when flipped matches are enabled.
+// Partial tiles at the right and bottom edges are padded with black.
+class Tileset {
+public:
+    static const quint16 FlipX = 0x8000;
+    static const quint16 FlipY = 0x4000;
+    static const quint16 IndexMask = 0x3FFF;
+
+    Tileset();
+
+    bool build(const QImage& image, int tileSize, bool matchFlips);
+    QByteArray toHex(const QString& prefix) const;
+    bool save(const QString& path) const;
+    QString errorString() const { return error; }
+
+    int tileSize() const { return size; }
+    int columns() const { return mapColumns; }
+    int rows() const { return mapRows; }
+    int tileCount() const { return uniqueTiles.size() / (size * size); }
+    const QVector<quint16>& tiles() const { return uniqueTiles; }
+    const QVector<quint16>& map() const { return tileMap; }
+
+private:
+    bool matches(const quint16* tile, quint16 entry) const;
+    void flipTile(const quint16* source, quint16* target, quint16 flags) const;
+
+    mutable QString error;
+    int size;
+    int mapColumns;
+    int mapRows;
+    int imageWidth;
+    int imageHeight;
+    bool flips;
+    QVector<quint16> uniqueTiles; // tileSize * tileSize values per tile
+    QVector<quint16> tileMap;
+};
+
+#endif // TILESET_H
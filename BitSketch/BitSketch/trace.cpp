@@ -0,0 +1,156 @@
+#include "trace.h"
+#include <QByteArrayList>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QMutex>
+#include <QThread>
+#include <QVector>
+#include <cstring>
+
+std::atomic<int> Trace::flags(0);
+std::atomic<const char*> Trace::operation(nullptr);
+
+namespace {
+
+struct Event {
+    const char* name;
+    qint64 startNs;
+    qint64 durationNs;
+    int thread;
+};
+
+struct ThreadName {
+    int thread;
+    QString name;
+};
+
+QMutex traceMutex;
+std::atomic<QThread*> trackedThread(nullptr);
+QString tracePath;
+QElapsedTimer traceClock;
+QVector<Event> events;
+QVector<ThreadName> threadNames;
+std::atomic<int> nextThreadId(1);
+
+// Small sequential ids read better in the viewer than native thread handles.
+// Called with traceMutex held.
+int currentThreadId() {
+    thread_local int id = 0;
+    if (id == 0) {
+        id = nextThreadId++;
+        QString name = QThread::currentThread()->objectName();
+        if (name.isEmpty()) {
+            const QCoreApplication* app = QCoreApplication::instance();
+            name = app && QThread::currentThread() == app->thread()
+                       ? QString("main")
+                       : QString("thread %1").arg(id);
+        }
+        threadNames.append({id, name});
+    }
+    return id;
+}
+
+QByteArray jsonString(const QString& text) {
+    QByteArray out = "\"";
+    for (QChar c : text) {
+        if (c == '"' || c == '\\') out += '\\';
+        out += c.unicode() < 0x20 ? ' ' : c.toLatin1();
+    }
+    return out + "\"";
+}
+
+} // namespace
+
+void Trace::startFromEnvironment(int argc, char* argv[]) {
+    QString path = QString::fromLocal8Bit(qgetenv("BITSKETCH_TRACE"));
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            path = QString::fromLocal8Bit(argv[i + 1]);
+        } else if (strncmp(argv[i], "--trace=", 8) == 0) {
+            path = QString::fromLocal8Bit(argv[i] + 8);
+        }
+    }
+    if (!path.isEmpty()) start(path);
+}
+
+void Trace::start(const QString& path) {
+    QMutexLocker locker(&traceMutex);
+    tracePath = path;
+    events.clear();
+    events.reserve(4096);
+    traceClock.start();
+    flags.fetch_or(Recording);
+}
+
+qint64 Trace::now() {
+    return traceClock.nsecsElapsed();
+}
+
+void Trace::record(const char* name, qint64 startNs, qint64 durationNs) {
+    QMutexLocker locker(&traceMutex);
+    events.append({name, startNs, durationNs, currentThreadId()});
+}
+
+// Operations are only tracked on the thread that turned tracking on (the GUI
+// thread); scopes on worker threads never touch the current operation.
+void Trace::setTrackOperations(bool track) {
+    if (track) {
+        trackedThread.store(QThread::currentThread());
+        flags.fetch_or(TrackingOperations);
+    } else {
+        flags.fetch_and(~TrackingOperations);
+        operation.store(nullptr);
+    }
+}
+
+void TraceScope::begin(const char* scopeName) {
+    const int flags = Trace::flags.load(std::memory_order_relaxed);
+    if (flags & Trace::Recording) {
+        startNs = Trace::now();
+    }
+    if ((flags & Trace::TrackingOperations) && QThread::currentThread() == trackedThread.load()) {
+        previousOperation = Trace::operation.exchange(scopeName);
+        tracked = true;
+    }
+    name = scopeName;
+}
+
+void TraceScope::end() {
+    if (startNs >= 0 && Trace::isEnabled()) {
+        Trace::record(name, startNs, Trace::now() - startNs);
+    }
+    if (tracked) {
+        Trace::operation.store(previousOperation);
+    }
+}
+
+void Trace::finish() {
+    if (!(flags.fetch_and(~Recording) & Recording)) return;
+    QMutexLocker locker(&traceMutex);
+
+    QFile file(tracePath);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+        qWarning("Can't write trace %s", qPrintable(tracePath));
+        return;
+    }
+
+    const qint64 pid = QCoreApplication::applicationPid();
+    QByteArrayList entries;
+    for (const ThreadName& thread : threadNames) {
+        entries.append(QString("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%1,\"tid\":%2,\"args\":{\"name\":")
+                           .arg(pid).arg(thread.thread).toLatin1()
+                       + jsonString(thread.name) + "}}");
+    }
+    for (const Event& event : events) {
+        entries.append("{\"name\":" + jsonString(QString::fromLatin1(event.name))
+                       + QString(",\"ph\":\"X\",\"pid\":%1,\"tid\":%2,\"ts\":%3,\"dur\":%4}")
+                             .arg(pid).arg(event.thread)
+                             .arg(event.startNs / 1000.0, 0, 'f', 3)
+                             .arg(event.durationNs / 1000.0, 0, 'f', 3)
+                             .toLatin1());
+    }
+    const QByteArray out = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n" + entries.join(",\n") + "\n]}\n";
+    file.write(out);
+    events.clear();
+}
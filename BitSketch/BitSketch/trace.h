@@ -0,0 +1,63 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <QString>
+#include <atomic>
+
+// Chrome/Perfetto trace-event recorder. Enabled with BITSKETCH_TRACE=<file>
+// or --trace <file>; the JSON is written when the application exits and can
+// be opened in chrome://tracing or ui.perfetto.dev.
+//
+// TRACE_SCOPE("name") records a complete event for the enclosing block and,
+// while operation tracking is on, marks it as the GUI thread's current
+// operation for the stall watchdog. When both are off a scope costs one
+// relaxed atomic load.
+class Trace {
+public:
+    static void startFromEnvironment(int argc, char* argv[]);
+    static void start(const QString& path);
+    static void finish();
+    static bool isActive() { return flags.load(std::memory_order_relaxed) != 0; }
+    static bool isEnabled() { return flags.load(std::memory_order_relaxed) & Recording; }
+
+    static void setTrackOperations(bool track);
+    static const char* currentOperation() { return operation.load(std::memory_order_relaxed); }
+
+    static qint64 now();
+    static void record(const char* name, qint64 startNs, qint64 durationNs);
+
+private:
+    friend class TraceScope;
+    enum Flag { Recording = 1, TrackingOperations = 2 };
+
+    static std::atomic<int> flags;
+    static std::atomic<const char*> operation;
+};
+
+class TraceScope {
+public:
+    explicit TraceScope(const char* name)
+        : name(nullptr), previousOperation(nullptr), startNs(-1), tracked(false) {
+        if (Trace::isActive()) begin(name);
+    }
+    ~TraceScope() {
+        if (name) end();
+    }
+
+private:
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+    void begin(const char* scopeName);
+    void end();
+
+    const char* name;
+    const char* previousOperation;
+    qint64 startNs;
+    bool tracked;
+};
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(traceScope, __LINE__)(name)
+
+#endif // TRACE_H
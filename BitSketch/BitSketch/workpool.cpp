@@ -0,0 +1,102 @@
+#include "workpool.h"
+
+namespace {
+
+thread_local WorkStealingPool* currentPool = nullptr;
+thread_local int currentWorker = -1;
+
+} // namespace
+
+WorkStealingPool::WorkStealingPool(int threadCount)
+    : queued(0), outstanding(0), nextWorker(0), stopping(false) {
+    const int count = qMax(1, threadCount);
+    for (int i = 0; i < count; ++i) {
+        workers.emplace_back(new Worker);
+    }
+    for (int i = 0; i < count; ++i) {
+        workers[i]->thread.reset(QThread::create([this, i] { run(i); }));
+        workers[i]->thread->start();
+    }
+}
+
+WorkStealingPool::~WorkStealingPool() {
+    waitForDone();
+    {
+        QMutexLocker locker(&stateMutex);
+        stopping = true;
+        wakeup.wakeAll();
+    }
+    for (auto& worker : workers) {
+        worker->thread->wait();
+    }
+}
+
+// The counters go up before the job is visible, so a worker finishing the
+// last job can never see outstanding == 0 while this one is on its way in.
+void WorkStealingPool::submit(std::function<void()> job) {
+    int index;
+    {
+        QMutexLocker locker(&stateMutex);
+        ++queued;
+        ++outstanding;
+        index = currentPool == this ? currentWorker : nextWorker++ % threadCount();
+    }
+    {
+        QMutexLocker locker(&workers[index]->mutex);
+        workers[index]->jobs.push_back(std::move(job));
+    }
+    QMutexLocker locker(&stateMutex);
+    wakeup.wakeOne();
+}
+
+void WorkStealingPool::waitForDone() {
+    QMutexLocker locker(&stateMutex);
+    while (outstanding > 0) {
+        done.wait(&stateMutex);
+    }
+}
+
+bool WorkStealingPool::takeJob(int index, std::function<void()>& job) {
+    {
+        Worker& own = *workers[index];
+        QMutexLocker locker(&own.mutex);
+        if (!own.jobs.empty()) {
+            job = std::move(own.jobs.back());
+            own.jobs.pop_back();
+            return true;
+        }
+    }
+    for (int i = 1; i < threadCount(); ++i) {
+        Worker& victim = *workers[(index + i) % threadCount()];
+        QMutexLocker locker(&victim.mutex);
+        if (!victim.jobs.empty()) {
+            job = std::move(victim.jobs.front());
+            victim.jobs.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void WorkStealingPool::run(int index) {
+    currentPool = this;
+    currentWorker = index;
+    forever {
+        std::function<void()> job;
+        if (takeJob(index, job)) {
+            {
+                QMutexLocker locker(&stateMutex);
+                --queued;
+            }
+            job();
+            QMutexLocker locker(&stateMutex);
+            if (--outstanding == 0) done.wakeAll();
+            continue;
+        }
+
+        QMutexLocker locker(&stateMutex);
+        if (queued > 0) continue;
+        if (stopping) return;
+        wakeup.wait(&stateMutex);
+    }
+}
@@ -0,0 +1,46 @@
+#ifndef WORKPOOL_H
+#define WORKPOOL_H
+
+#include <QMutex>
+#include <QThread>
+#include <QWaitCondition>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <vector>
+
+// Fixed set of worker threads, each with its own job deque. A worker runs
+// its newest job first and, when it runs dry, steals the oldest job of
+// another worker. Jobs submitted from inside a job go to the submitting
+// worker, so follow-up work stays on the thread whose caches are warm.
+// waitForDone() must not be called from inside a job.
+class WorkStealingPool {
+public:
+    explicit WorkStealingPool(int threadCount = QThread::idealThreadCount());
+    ~WorkStealingPool();
+
+    void submit(std::function<void()> job);
+    void waitForDone();
+    int threadCount() const { return int(workers.size()); }
+
+private:
+    struct Worker {
+        QMutex mutex;
+        std::deque<std::function<void()>> jobs;
+        std::unique_ptr<QThread> thread;
+    };
+
+    void run(int index);
+    bool takeJob(int index, std::function<void()>& job);
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    QMutex stateMutex;
+    QWaitCondition wakeup;
+    QWaitCondition done;
+    int queued;
+    int outstanding;
+    int nextWorker;
+    bool stopping;
+};
+
+#endif // WORKPOOL_H